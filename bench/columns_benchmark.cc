@@ -0,0 +1,173 @@
+// Columns_benchmark.cc
+//
+// Distance ordering, year filtering and name scans on the columnar store
+// against the record-per-node layout it replaced: AffiliationData/PublicationData
+// as values of std::unordered_maps, with the name and the ID vectors pulled
+// into cache by every lookup. RowStore below is that layout and does the
+// operations the way the old code did (sort with a map lookup per comparison).
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc bench/columns_benchmark.cc -o columns_benchmark
+//   ./columns_benchmark [publications, default 1000000]
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+using namespace harness;
+
+namespace
+{
+// Layout before the columns
+struct RowStore
+{
+    struct AffiliationData {
+        Name name;
+        Coord coords;
+        std::vector<PublicationID> related_pubs;
+    };
+
+    struct PublicationData {
+        Name name;
+        Year year;
+        std::vector<AffiliationID> related_affs;
+        std::vector<PublicationID> references;
+        PublicationID parent;
+    };
+
+    std::vector<AffiliationID> affIDList;
+    std::unordered_map<AffiliationID, AffiliationData> affiliations_map;
+    std::unordered_map<PublicationID, PublicationData> publications_map;
+
+    void add(std::vector<AffiliationRecord> const& affiliations, std::vector<PublicationRecord> const& publications)
+    {
+        for ( auto const& a : affiliations ) {
+            affIDList.push_back(a.id);
+            affiliations_map[a.id] = {a.name, a.xy, {}};
+        }
+        for ( auto const& p : publications ) {
+            publications_map[p.id] = {p.name, p.year, p.affiliations, {}, NO_PUBLICATION};
+            for ( auto const& a : p.affiliations ) { affiliations_map[a].related_pubs.push_back(p.id); }
+        }
+    }
+
+    //Comparator as before, in 64 bits so that it doesn't overflow
+    std::vector<AffiliationID> distance_increasing()
+    {
+        auto const& a = affiliations_map;
+        std::sort(affIDList.begin(), affIDList.end(), [&a](auto const& i1, auto const& i2)
+        {
+            Coord coord1 = a.at(i1).coords;
+            Coord coord2 = a.at(i2).coords;
+            long long dist1 = 1LL * coord1.x * coord1.x + 1LL * coord1.y * coord1.y;
+            long long dist2 = 1LL * coord2.x * coord2.x + 1LL * coord2.y * coord2.y;
+            if ( dist1 != dist2 ) { return dist1 < dist2; }
+            return coord1.y < coord2.y;
+        });
+        return affIDList;
+    }
+
+    std::vector<std::pair<Year, PublicationID>> publications_after(AffiliationID const& id, Year year)
+    {
+        std::vector<std::pair<Year, PublicationID>> result;
+        auto const& p_map = publications_map;
+        auto& p_vec = affiliations_map.at(id).related_pubs;
+        std::sort(p_vec.begin(), p_vec.end(), [&p_map](auto const& i1, auto const& i2)
+        {
+            if ( p_map.at(i1).year == p_map.at(i2).year ) { return p_map.at(i1).name < p_map.at(i2).name; }
+            return p_map.at(i1).year < p_map.at(i2).year;
+        });
+        for ( auto const& pub : p_vec ) {
+            auto current_year = p_map.at(pub).year;
+            if ( current_year >= year ) { result.push_back({current_year, pub}); }
+        }
+        return result;
+    }
+
+    std::vector<PublicationID> publications_containing(Name const& substring) const
+    {
+        std::vector<PublicationID> result;
+        for ( auto const& p : publications_map ) {
+            if ( p.second.name.find(substring) != Name::npos ) { result.push_back(p.first); }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    std::size_t count_after(Year year) const
+    {
+        std::size_t count = 0;
+        for ( auto const& p : publications_map ) { count += p.second.year >= year; }
+        return count;
+    }
+};
+
+void report(char const* name, double rows_ns, double columns_ns)
+{
+    std::cout << std::setw(44) << std::left << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << rows_ns / 1000 << std::setw(14) << columns_ns / 1000
+              << std::setw(9) << rows_ns / columns_ns << "x" << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    unsigned int affiliations = n / 10;
+
+    rand_engine.seed(1);
+    auto aff_records = make_affiliations(0, affiliations);
+    auto pub_records = make_publications(0, n, affiliations);
+
+    RowStore rows;
+    rows.add(aff_records, pub_records);
+    Datastructures ds;
+    ds.add_affiliations(aff_records);
+    ds.add_publications(pub_records);
+    aff_records.clear();
+    pub_records.clear();
+
+    std::vector<AffiliationID> probes;
+    for ( unsigned int i = 0; i < 1024; ++i ) { probes.push_back(affiliation_id(random_in_range(0u, affiliations - 1))); }
+
+    std::cout << n << " publications, " << affiliations << " affiliations" << std::endl;
+    std::cout << std::setw(44) << std::left << "us/call" << std::right
+              << std::setw(14) << "node maps" << std::setw(14) << "columns" << std::setw(10) << "speedup" << std::endl;
+
+    //The old store sorted affIDList in place, shuffle it so that every call sorts again
+    double rows_ns = ns_per_call([&](unsigned int) {
+        std::shuffle(rows.affIDList.begin(), rows.affIDList.end(), rand_engine);
+        keep(rows.distance_increasing()); }, 1, 0.5);
+    double shuffle_ns = ns_per_call([&](unsigned int) {
+        std::shuffle(rows.affIDList.begin(), rows.affIDList.end(), rand_engine);
+        keep(rows.affIDList); }, 1, 0.5);
+    double columns_ns = ns_per_call([&](unsigned int) { keep(ds.get_affiliations_distance_increasing_from({0, 0})); }, 1, 0.5);
+    report("distance ordering, full sort", rows_ns - shuffle_ns, columns_ns);
+    columns_ns = ns_per_call([&](unsigned int) { keep(ds.get_affiliations_distance_increasing()); }, 1, 0.5);
+    report("distance ordering, kept index", rows_ns - shuffle_ns, columns_ns);
+
+    rows_ns = ns_per_call([&](unsigned int i) { keep(rows.publications_after(probes[i % probes.size()], 2000)); }, 64, 0.5);
+    columns_ns = ns_per_call([&](unsigned int i) { keep(ds.get_publications_after(probes[i % probes.size()], 2000)); }, 64, 0.5);
+    report("get_publications_after", rows_ns, columns_ns);
+
+    //Whole-store year filter: nodes against the year column
+    rows_ns = ns_per_call([&](unsigned int) { keep(rows.count_after(2000)); }, 1, 0.5);
+    columns_ns = ns_per_call([&](unsigned int) {
+        std::size_t count = 0;
+        for ( std::size_t s = 0; s < ds.pub_ids.size(); ++s ) {
+            count += ds.pub_ids[s] != NO_PUBLICATION && ds.pub_years[s] >= 2000;
+        }
+        keep(count); }, 1, 0.5);
+    report("year filter over all publications", rows_ns, columns_ns);
+
+    //Substrings shorter than a trigram are searched by scanning every name,
+    //in the name pool against one std::string per node
+    rows_ns = ns_per_call([&](unsigned int) { keep(rows.publications_containing("qz")); }, 1, 0.5);
+    columns_ns = ns_per_call([&](unsigned int) { keep(ds.find_publications_by_substring("qz")); }, 1, 0.5);
+    report("substring scan over all names", rows_ns, columns_ns);
+
+    return 0;
+}
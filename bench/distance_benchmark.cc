@@ -0,0 +1,71 @@
+// Distance_benchmark.cc
+//
+// Ordering every affiliation by distance from a point: the vectorized
+// squared-distance kernel with a sort on the precomputed keys
+// (get_affiliations_distance_increasing_from) against the comparator the
+// store used before, which computes both distances in every comparison.
+// The comparator is given 64 bit math here so that it gives the same order.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc bench/distance_benchmark.cc -o distance_benchmark
+//   ./distance_benchmark [largest affiliation count, default 1000000]
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace harness;
+
+namespace
+{
+std::vector<AffiliationID> comparator_sort(std::vector<std::pair<AffiliationID, Coord>> affiliations, Coord origin)
+{
+    std::sort(affiliations.begin(), affiliations.end(), [origin](auto const& a1, auto const& a2)
+    {
+        long long x1 = static_cast<long long>(a1.second.x) - origin.x;
+        long long y1 = static_cast<long long>(a1.second.y) - origin.y;
+        long long x2 = static_cast<long long>(a2.second.x) - origin.x;
+        long long y2 = static_cast<long long>(a2.second.y) - origin.y;
+        unsigned long long dist1 = x1 * x1 + y1 * y1;
+        unsigned long long dist2 = x2 * x2 + y2 * y2;
+        if ( dist1 != dist2 ) { return dist1 < dist2; }
+        return a1.second.y < a2.second.y;
+    });
+    std::vector<AffiliationID> result;
+    result.reserve(affiliations.size());
+    for ( auto& a : affiliations ) { result.push_back(std::move(a.first)); }
+    return result;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int largest = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    std::cout << std::setw(10) << "n" << std::setw(16) << "comparator ms" << std::setw(14) << "kernel ms"
+              << std::setw(10) << "speedup" << std::endl;
+    for ( unsigned int n = 10000; n <= largest; n *= 10 ) {
+        rand_engine.seed(n);
+        Datastructures ds;
+        ds.add_affiliations(make_affiliations(0, n));
+
+        std::vector<std::pair<AffiliationID, Coord>> affiliations;
+        for ( auto const& id : ds.get_all_affiliations() ) { affiliations.push_back({id, ds.get_affiliation_coord(id)}); }
+        Coord origin = random_coord();
+
+        //Both give the same order, ties included
+        if ( comparator_sort(affiliations, origin) != ds.get_affiliations_distance_increasing_from(origin) ) {
+            std::cout << "orders differ at n = " << n << std::endl;
+            return 1;
+        }
+
+        double comparator_ns = ns_per_call([&](unsigned int) { keep(comparator_sort(affiliations, origin)); }, 1, 0.5);
+        double kernel_ns = ns_per_call([&](unsigned int) { keep(ds.get_affiliations_distance_increasing_from(origin)); }, 1, 0.5);
+        std::cout << std::setw(10) << n << std::fixed << std::setprecision(2)
+                  << std::setw(16) << comparator_ns / 1e6 << std::setw(14) << kernel_ns / 1e6
+                  << std::setw(9) << comparator_ns / kernel_ns << "x" << std::endl;
+    }
+    return 0;
+}
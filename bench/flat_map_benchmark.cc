@@ -0,0 +1,95 @@
+// Flat_map_benchmark.cc
+//
+// Insert and lookup throughput of FlatHashMap against std::unordered_map for
+// the two key types the store uses: publication IDs (unsigned long long)
+// and coordinates (Coord, with CoordHash for std::unordered_map). Inserts
+// are timed with and without reserve(), the bulk load path. Lookups hit in
+// random order, misses look for keys that aren't there.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc bench/flat_map_benchmark.cc -o flat_map_benchmark
+//   ./flat_map_benchmark [keys, default 1000000]
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+using namespace harness;
+
+namespace
+{
+struct Throughput
+{
+    double insert = 0;           // million keys per second
+    double insert_reserved = 0;
+    double hit = 0;
+    double miss = 0;
+};
+
+template <typename Map, typename Key>
+Throughput measure(std::vector<Key> const& keys, std::vector<Key> const& missing)
+{
+    Throughput t;
+    std::size_t n = keys.size();
+    auto insert_all = [&](Map& map)
+    {
+        auto start = Clock::now();
+        for ( std::size_t i = 0; i < n; ++i ) { map.insert({keys[i], static_cast<unsigned int>(i)}); }
+        return n / seconds_since(start) / 1e6;
+    };
+
+    {
+        Map map;
+        t.insert = insert_all(map);
+    }
+    Map map;
+    map.reserve(n);
+    t.insert_reserved = insert_all(map);
+
+    //Hits in an order unrelated to the insertion order
+    double ns = ns_per_call([&](unsigned int i) { keep(map.find(keys[(i * 7919ull) % n])->second); }, n);
+    t.hit = 1e3 / ns;
+    ns = ns_per_call([&](unsigned int i) { keep(map.find(missing[i % n]) == map.end()); }, n);
+    t.miss = 1e3 / ns;
+    return t;
+}
+
+void report(char const* name, Throughput const& t)
+{
+    std::cout << std::setw(34) << std::left << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << t.insert << std::setw(12) << t.insert_reserved
+              << std::setw(10) << t.hit << std::setw(10) << t.miss << std::endl;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    rand_engine.seed(1);
+    std::vector<PublicationID> ids;
+    std::vector<PublicationID> missing_ids;
+    std::vector<Coord> coords;
+    std::vector<Coord> missing_coords;
+    for ( unsigned int i = 0; i < n; ++i ) {
+        ids.push_back(publication_id(i));
+        missing_ids.push_back(publication_id(i) + 1);
+        //Grid points, the worst case for the old xor/shift combine
+        coords.push_back({static_cast<int>(i % 1000) * 10, static_cast<int>(i / 1000) * 10});
+        missing_coords.push_back({static_cast<int>(i % 1000) * 10 + 5, static_cast<int>(i / 1000) * 10});
+    }
+    std::shuffle(ids.begin(), ids.end(), rand_engine);
+    std::shuffle(coords.begin(), coords.end(), rand_engine);
+
+    std::cout << n << " keys, million operations per second" << std::endl;
+    std::cout << std::setw(34) << std::left << "" << std::right << std::setw(10) << "insert"
+              << std::setw(12) << "reserved" << std::setw(10) << "hit" << std::setw(10) << "miss" << std::endl;
+    report("FlatHashMap<PublicationID>", measure<FlatHashMap<PublicationID, unsigned int>>(ids, missing_ids));
+    report("std::unordered_map<PublicationID>", measure<std::unordered_map<PublicationID, unsigned int>>(ids, missing_ids));
+    report("FlatHashMap<Coord>", measure<FlatHashMap<Coord, unsigned int>>(coords, missing_coords));
+    report("std::unordered_map<Coord>", measure<std::unordered_map<Coord, unsigned int, CoordHash>>(coords, missing_coords));
+    return 0;
+}
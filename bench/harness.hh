@@ -0,0 +1,218 @@
+// Harness.hh
+//
+// Shared by the scaling test and the benchmarks: synthetic data generated
+// with random_in_range/rand_engine, timing of repeated calls and fitting of
+// growth curves to the measured times.
+
+#ifndef HARNESS_HH
+#define HARNESS_HH
+
+#include "datastructures.hh"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace harness
+{
+
+// Synthetic data. Affiliation i has ID "A<i>" and publication i has ID
+// publication_id(i), so queries can pick existing (and missing) IDs at random.
+inline AffiliationID affiliation_id(unsigned int i) { return "A" + std::to_string(i); }
+inline PublicationID publication_id(unsigned int i) { return 1000000ull + 3ull * i; }
+
+inline Name random_name(unsigned int length)
+{
+    Name name(length, ' ');
+    for ( auto& c : name ) { c = random_in_range('a', 'z'); }
+    return name;
+}
+
+inline Coord random_coord() { return {random_in_range(0, 10000000), random_in_range(0, 10000000)}; }
+
+inline std::vector<AffiliationRecord> make_affiliations(unsigned int first, unsigned int count)
+{
+    std::vector<AffiliationRecord> affiliations;
+    affiliations.reserve(count);
+    for ( unsigned int i = first; i < first + count; ++i ) {
+        affiliations.push_back({affiliation_id(i), random_name(random_in_range(5u, 20u)), random_coord()});
+    }
+    return affiliations;
+}
+
+// Publications with 1-3 affiliations picked from the first affiliation_count ones
+inline std::vector<PublicationRecord> make_publications(unsigned int first, unsigned int count, unsigned int affiliation_count)
+{
+    std::vector<PublicationRecord> publications;
+    publications.reserve(count);
+    for ( unsigned int i = first; i < first + count; ++i ) {
+        PublicationRecord p{publication_id(i), random_name(random_in_range(10u, 40u)),
+                            random_in_range<Year>(1950, 2024), {}};
+        unsigned int k = random_in_range(1u, 3u);
+        for ( unsigned int j = 0; j < k; ++j ) {
+            p.affiliations.push_back(affiliation_id(random_in_range(0u, affiliation_count - 1)));
+        }
+        publications.push_back(std::move(p));
+    }
+    return publications;
+}
+
+// Random forest: publication i (i > 0) is referenced by a random earlier one,
+// which gives trees of logarithmic expected depth
+inline std::vector<ReferenceRecord> make_references(unsigned int first, unsigned int count)
+{
+    std::vector<ReferenceRecord> references;
+    references.reserve(count);
+    for ( unsigned int i = std::max(first, 1u); i < first + count; ++i ) {
+        references.push_back({publication_id(i), publication_id(random_in_range(0u, i - 1))});
+    }
+    return references;
+}
+
+// Fills ds with affiliations and publications (and references) through the
+// batch operations. Records are generated in chunks so that only one chunk
+// of them is in memory at a time.
+inline void fill(Datastructures& ds, unsigned int affiliations, unsigned int publications, bool references = true)
+{
+    const unsigned int CHUNK = 100000;
+    for ( unsigned int i = 0; i < affiliations; i += CHUNK ) {
+        ds.add_affiliations(make_affiliations(i, std::min(CHUNK, affiliations - i)));
+    }
+    for ( unsigned int i = 0; i < publications; i += CHUNK ) {
+        ds.add_publications(make_publications(i, std::min(CHUNK, publications - i), affiliations));
+    }
+    for ( unsigned int i = 0; references && i < publications; i += CHUNK ) {
+        ds.add_references(make_references(i, std::min(CHUNK, publications - i)));
+    }
+}
+
+// Keeps the compiler from optimizing a result away
+template <typename T>
+inline void keep(T const& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Average ns per call of call(i), i = 0, 1, 2, ... Calls are repeated in
+// rounds, each twice as long as the one before, until min_seconds have
+// passed, so that fast calls are timed without the clock in between.
+template <typename Call>
+double ns_per_call(Call call, unsigned int first_round, double min_seconds = 0.05)
+{
+    unsigned long long calls = 0;
+    unsigned long long round = std::max(first_round, 1u);
+    auto start = Clock::now();
+    double elapsed = 0;
+    do {
+        for ( unsigned long long i = 0; i < round; ++i ) { call(calls + i); }
+        calls += round;
+        round *= 2;
+        elapsed = seconds_since(start);
+    } while ( elapsed < min_seconds );
+    return elapsed * 1e9 / calls;
+}
+
+// Growth classes, in increasing order
+enum class Growth { constant, logarithmic, linear, linearithmic, quadratic };
+
+inline char const* growth_name(Growth g)
+{
+    switch ( g ) {
+    case Growth::constant: return "O(1)";
+    case Growth::logarithmic: return "O(logn)";
+    case Growth::linear: return "O(n)";
+    case Growth::linearithmic: return "O(nlogn)";
+    case Growth::quadratic: return "O(n^2)";
+    }
+    return "?";
+}
+
+inline double growth_value(Growth g, double n)
+{
+    switch ( g ) {
+    case Growth::constant: return 1;
+    case Growth::logarithmic: return std::log2(n);
+    case Growth::linear: return n;
+    case Growth::linearithmic: return n * std::log2(n);
+    case Growth::quadratic: return n * n;
+    }
+    return 1;
+}
+
+struct Fit
+{
+    double slope = 0;              // of log(time) against log(n), 0 = flat, 1 = linear
+    Growth growth = Growth::constant;  // class whose curve fits the times best
+};
+
+// Least squares slope on the log-log scale, and the growth class g for which
+// time/g(n) varies least. A simpler class wins unless a more complex one fits
+// clearly better, so that timing noise doesn't make O(1) look like O(logn).
+inline Fit fit_growth(std::vector<double> const& sizes, std::vector<double> const& times)
+{
+    Fit fit;
+    std::size_t m = sizes.size();
+    if ( m < 2 ) { return fit; }
+
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for ( std::size_t i = 0; i < m; ++i ) {
+        double x = std::log(sizes[i]);
+        double y = std::log(std::max(times[i], 1e-3));
+        sx += x; sy += y; sxx += x * x; sxy += x * y;
+    }
+    fit.slope = (m * sxy - sx * sy) / (m * sxx - sx * sx);
+
+    //Spread of log(time/g(n)) around its mean for each class
+    double best = -1;
+    std::vector<double> spreads;
+    for ( int g = 0; g <= static_cast<int>(Growth::quadratic); ++g ) {
+        std::vector<double> ratios;
+        double mean = 0;
+        for ( std::size_t i = 0; i < m; ++i ) {
+            ratios.push_back(std::log(std::max(times[i], 1e-3) / growth_value(static_cast<Growth>(g), sizes[i])));
+            mean += ratios.back() / m;
+        }
+        double spread = 0;
+        for ( auto r : ratios ) { spread += (r - mean) * (r - mean); }
+        spreads.push_back(std::sqrt(spread / m));
+        if ( best < 0 || spreads.back() < best ) { best = spreads.back(); }
+    }
+    for ( int g = 0; g <= static_cast<int>(Growth::quadratic); ++g ) {
+        if ( spreads[g] <= 1.5 * best + 0.05 ) {
+            fit.growth = static_cast<Growth>(g);
+            break;
+        }
+    }
+    return fit;
+}
+
+// Log-log slope of growth class g between n1 and n2, e.g. 0 for O(1) and 1 for O(n)
+inline double expected_slope(Growth g, double n1, double n2)
+{
+    return std::log(growth_value(g, n2) / growth_value(g, n1)) / std::log(n2 / n1);
+}
+
+// Whether times grow faster than the documented class allows. Slopes are
+// compared rather than fitted classes: cache and TLB misses add up to about
+// 0.3 to the slope of anything that touches memory proportional to n, which
+// is enough to make a fitted O(1) look like O(logn) or an O(n) look like O(nlogn).
+const double SLOPE_TOLERANCE = 0.35;
+
+inline bool exceeds(Fit const& fit, Growth documented, std::vector<double> const& sizes)
+{
+    if ( sizes.size() < 2 ) { return false; }
+    return fit.slope > expected_slope(documented, sizes.front(), sizes.back()) + SLOPE_TOLERANCE;
+}
+
+} // namespace harness
+
+#endif // HARNESS_HH
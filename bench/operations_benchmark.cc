@@ -0,0 +1,310 @@
+// Operations_benchmark.cc
+//
+// Times every public Datastructures operation at 10^3 .. 10^7 publications
+// (and a tenth as many affiliations) on data from the harness generator,
+// fits the growth curve of each operation and flags every one whose
+// measured growth exceeds its "Estimate of performance" in datastructures.hh,
+// that is whose log-log slope is above the slope of the documented class by
+// more than harness::SLOPE_TOLERANCE.
+//
+// The documented estimates are restated below in terms of n for the
+// generated data: an affiliation has about 20 publications and 40
+// connections, a publication 1-3 affiliations, the reference forest has
+// logarithmic depth and radius/rectangle/name queries are sized so that
+// their result stays about the same size. Estimates in terms of such
+// quantities are constant (or logarithmic) in n here.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc bench/operations_benchmark.cc -o operations_benchmark
+//   ./operations_benchmark [largest size, default 10000000] [operation name filter]
+// Exit status is 1 if any operation was flagged.
+
+#include "bench/harness.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+using namespace harness;
+
+namespace
+{
+const unsigned int PROBES = 1024;
+const unsigned int BATCH = 1000;
+const char* const SNAPSHOT_FILE = "operations_benchmark.snap";
+const char* const TEXT_FILE = "operations_benchmark.txt";
+
+// Queries are repeated with the probe arguments until enough time has passed,
+// after one untimed call that brings the lazily rebuilt tables up to date.
+// Updates change the store, every call gets arguments of its own and the
+// calls are timed once. Operations run once are timed for a single call.
+enum class Kind { query, update, once };
+
+// State for one size: the store and the arguments the calls pick from
+struct Context
+{
+    Datastructures ds;
+    unsigned int n = 0;             // publications
+    unsigned int affiliations = 0;
+    unsigned int updates = 0;       // calls per update operation
+    int radius = 0;                 // about 10 affiliations within
+    std::vector<PublicationID> pubs;          // from the first half, never removed
+    std::vector<AffiliationID> affs;          // from the first half, never removed
+    std::vector<Coord> coords;                // of affs
+    std::vector<Name> aff_names;              // of affs
+    std::vector<Name> pub_names;              // of pubs
+    std::vector<PublicationID> victim_pubs;   // from the second half, removed by the removals
+    std::vector<AffiliationID> victim_affs;
+    std::vector<PublicationID> new_pubs;      // not in the store when the updates start
+    std::vector<AffiliationID> new_affs;
+    std::vector<AffiliationRecord> aff_batch; // new records for the batch operations
+    std::vector<PublicationRecord> pub_batch;
+    std::vector<ReferenceRecord> ref_batch;
+};
+
+struct Operation
+{
+    char const* name;
+    Growth documented;
+    Kind kind;
+    std::function<void(Context&, unsigned int)> call;  // call(context, i), i = call number
+    unsigned int records = 1;  // time is divided by this, for the batch operations
+};
+
+PublicationID pub(Context& c, unsigned int i) { return c.pubs[i % PROBES]; }
+AffiliationID const& aff(Context& c, unsigned int i) { return c.affs[i % PROBES]; }
+AffiliationID const& aff2(Context& c, unsigned int i) { return c.affs[(i * 7 + 3) % PROBES]; }
+
+std::vector<Operation> operations()
+{
+    using G = Growth;
+    using K = Kind;
+    return {
+        {"get_affiliation_count", G::constant, K::query, [](Context& c, unsigned int) { keep(c.ds.get_affiliation_count()); }},
+        {"get_all_affiliations", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.get_all_affiliations()); }},
+        {"get_affiliation_name", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_affiliation_name(aff(c, i))); }},
+        {"get_affiliation_coord", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_affiliation_coord(aff(c, i))); }},
+        {"get_affiliations_alphabetically", G::linear, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_affiliations_alphabetically()); }},
+        {"get_affiliations_distance_increasing", G::linear, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_affiliations_distance_increasing()); }},
+        {"get_affiliations_alphabetically (page)", G::constant, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_affiliations_alphabetically(0, 10)); }},
+        {"get_affiliations_distance_increasing (page)", G::constant, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_affiliations_distance_increasing(0, 10)); }},
+        {"get_affiliations_distance_increasing_from", G::linearithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_affiliations_distance_increasing_from(c.coords[i % PROBES])); }},
+        {"find_affiliation_with_coord", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.find_affiliation_with_coord(c.coords[i % PROBES])); }},
+        {"all_publications", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.all_publications()); }},
+        {"get_publication_name", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_publication_name(pub(c, i))); }},
+        {"get_publication_year", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_publication_year(pub(c, i))); }},
+        {"get_affiliations", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_affiliations(pub(c, i))); }},
+        {"get_direct_references", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_direct_references(pub(c, i))); }},
+        {"get_publications", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_publications(aff(c, i))); }},
+        {"get_parent", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_parent(pub(c, i))); }},
+        {"get_publications_after", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_publications_after(aff(c, i), 2000)); }},
+        {"get_publications_between", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_publications_between(aff(c, i), 1990, 2000)); }},
+        {"get_publication_count_between", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_publication_count_between(aff(c, i), 1990, 2000)); }},
+        {"get_total_publication_count_between", G::constant, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_total_publication_count_between(1990, 2000)); }},
+        {"get_top_affiliations_between", G::linear, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_top_affiliations_between(1990, 2000, 10)); }},
+        {"get_referenced_by_chain", G::logarithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_referenced_by_chain(pub(c, i))); }},
+        //O(m) copy of the labelled interval, a random publication has O(logn) references in the generated forest
+        {"get_all_references", G::logarithmic, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_all_references(pub(c, i))); }},
+        {"get_affiliations_closest_to", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_affiliations_closest_to(c.coords[i % PROBES])); }},
+        {"get_affiliations_nearest", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_affiliations_nearest(c.coords[i % PROBES], 10)); }},
+        {"get_affiliations_within_radius", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_affiliations_within_radius(c.coords[i % PROBES], c.radius)); }},
+        {"get_affiliations_in_rectangle", G::constant, K::query, [](Context& c, unsigned int i) {
+             Coord xy = c.coords[i % PROBES];
+             keep(c.ds.get_affiliations_in_rectangle({xy.x - c.radius, xy.y - c.radius}, {xy.x + c.radius, xy.y + c.radius})); }},
+        {"get_closest_common_parent", G::logarithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_closest_common_parent(pub(c, i), pub(c, i * 7 + 3))); }},
+        {"get_kth_parent", G::logarithmic, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_kth_parent(pub(c, i), 2)); }},
+        {"is_ancestor", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.is_ancestor(pub(c, i * 7 + 3), pub(c, i))); }},
+        {"get_all_references_count", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_all_references_count(pub(c, i))); }},
+        {"find_affiliations_by_prefix", G::logarithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.find_affiliations_by_prefix(c.aff_names[i % PROBES])); }},
+        {"find_affiliations_by_name", G::logarithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.find_affiliations_by_name(c.aff_names[i % PROBES])); }},
+        {"find_publications_by_name", G::logarithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.find_publications_by_name(c.pub_names[i % PROBES])); }},
+        //Candidates of the rarest trigram grow with n
+        {"find_publications_by_substring", G::linear, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.find_publications_by_substring(c.pub_names[i % PROBES].substr(2, 6))); }},
+        {"get_connected_affiliations", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_connected_affiliations(aff(c, i))); }},
+        {"get_all_connections", G::linearithmic, K::query, [](Context& c, unsigned int) { keep(c.ds.get_all_connections()); }},
+        {"get_any_path", G::linear, K::query, [](Context& c, unsigned int i) { keep(c.ds.get_any_path(aff(c, i), aff2(c, i))); }},
+        {"get_path_with_least_affiliations", G::linear, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_path_with_least_affiliations(aff(c, i), aff2(c, i))); }},
+        {"get_path_of_least_friction", G::linearithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_path_of_least_friction(aff(c, i), aff2(c, i))); }},
+        {"get_shortest_path", G::linearithmic, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.get_shortest_path(aff(c, i), aff2(c, i))); }},
+        {"get_top_publications_by_influence", G::linear, K::query,
+         [](Context& c, unsigned int) { keep(c.ds.get_top_publications_by_influence(10)); }},
+        {"view_all_affiliations", G::constant, K::query, [](Context& c, unsigned int) { keep(c.ds.view_all_affiliations()); }},
+        {"view_all_publications", G::constant, K::query, [](Context& c, unsigned int) { keep(c.ds.view_all_publications()); }},
+        {"view_affiliations", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.view_affiliations(pub(c, i))); }},
+        {"view_direct_references", G::constant, K::query,
+         [](Context& c, unsigned int i) { keep(c.ds.view_direct_references(pub(c, i))); }},
+        {"view_publications", G::constant, K::query, [](Context& c, unsigned int i) { keep(c.ds.view_publications(aff(c, i))); }},
+        {"get_all_references_range", G::constant, K::query, [](Context& c, unsigned int i) {
+             auto range = c.ds.get_all_references_range(pub(c, i));
+             keep(range.begin() != range.end()); }},
+        {"snapshot", G::constant, K::query, [](Context& c, unsigned int) { keep(c.ds.snapshot()); }},
+        //Nothing changes between the calls, so after the first one every publish reuses the older snapshot
+        {"publish_snapshot", G::constant, K::query, [](Context& c, unsigned int) { c.ds.publish_snapshot(); }},
+        {"save_snapshot", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.save_snapshot(SNAPSHOT_FILE)); }},
+        {"load_snapshot", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.load_snapshot(SNAPSHOT_FILE)); }},
+        {"stats_text", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.stats_text()); }},
+        {"stats_json", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.stats_json()); }},
+        {"reset_stats", G::constant, K::query, [](Context& c, unsigned int) { c.ds.reset_stats(); }},
+        {"memory_usage", G::linear, K::query, [](Context& c, unsigned int) { keep(c.ds.memory_usage()); }},
+        {"compact", G::linearithmic, K::query, [](Context& c, unsigned int) { c.ds.compact(); }},
+
+        //Updates, each call adds or changes something new
+        {"add_affiliation", G::logarithmic, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.add_affiliation(c.new_affs[i], "new affiliation", random_coord())); }},
+        {"change_affiliation_coord", G::logarithmic, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.change_affiliation_coord(c.new_affs[i], random_coord())); }},
+        {"add_publication", G::constant, K::update, [](Context& c, unsigned int i) {
+             keep(c.ds.add_publication(c.new_pubs[i], "new publication", 2000, {aff(c, i), aff2(c, i)})); }},
+        {"add_affiliation_to_publication", G::constant, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.add_affiliation_to_publication(c.new_affs[i], c.new_pubs[i])); }},
+        {"add_reference", G::logarithmic, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.add_reference(c.new_pubs[i], pub(c, i))); }},
+        {"add_affiliations", G::logarithmic, K::once, [](Context& c, unsigned int) { keep(c.ds.add_affiliations(c.aff_batch)); }, BATCH},
+        {"add_publications", G::constant, K::once, [](Context& c, unsigned int) { keep(c.ds.add_publications(c.pub_batch)); }, BATCH},
+        {"add_references", G::logarithmic, K::once, [](Context& c, unsigned int) { keep(c.ds.add_references(c.ref_batch)); }, BATCH},
+        {"load_text", G::logarithmic, K::once, [](Context& c, unsigned int) { keep(c.ds.load_text(TEXT_FILE, 1)); }, BATCH},
+        {"remove_affiliation", G::logarithmic, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.remove_affiliation(c.victim_affs[i])); }},
+        {"remove_publication", G::constant, K::update,
+         [](Context& c, unsigned int i) { keep(c.ds.remove_publication(c.victim_pubs[i])); }},
+        {"remove_publications", G::constant, K::update, [](Context& c, unsigned int i) {
+             std::vector<PublicationID> batch(c.victim_pubs.begin() + c.updates + 4 * i, c.victim_pubs.begin() + c.updates + 4 * i + 4);
+             keep(c.ds.remove_publications(batch)); }, 4},
+        //Last, there is nothing left after this. The generated IDs are short, so no element is visited,
+        //what still grows with n is the system taking the freed pages back
+        {"clear_all", G::linear, K::once, [](Context& c, unsigned int) { c.ds.clear_all(); }},
+    };
+}
+
+void prepare(Context& c, unsigned int n)
+{
+    c.n = n;
+    c.affiliations = n / 10;
+    c.updates = std::min(1000u, c.affiliations / 8);
+    //About 10 affiliations in a circle of this radius
+    c.radius = static_cast<int>(std::sqrt(10.0 * 1e14 / c.affiliations / 3.14159));
+    fill(c.ds, c.affiliations, n);
+
+    for ( unsigned int i = 0; i < PROBES; ++i ) {
+        unsigned int a = random_in_range(0u, c.affiliations / 2 - 1);
+        c.affs.push_back(affiliation_id(a));
+        c.coords.push_back(c.ds.get_affiliation_coord(c.affs.back()));
+        c.aff_names.push_back(c.ds.get_affiliation_name(c.affs.back()));
+        c.pubs.push_back(publication_id(random_in_range(0u, n / 2 - 1)));
+        c.pub_names.push_back(c.ds.get_publication_name(c.pubs.back()));
+    }
+    //Victims and new IDs are distinct
+    for ( unsigned int i = 0; i < 5 * c.updates; ++i ) { c.victim_pubs.push_back(publication_id(n / 2 + i)); }
+    for ( unsigned int i = 0; i < c.updates; ++i ) {
+        c.victim_affs.push_back(affiliation_id(c.affiliations / 2 + i));
+        c.new_pubs.push_back(publication_id(n + i));
+        c.new_affs.push_back(affiliation_id(c.affiliations + i));
+    }
+    unsigned int first_aff = c.affiliations + c.updates;
+    unsigned int first_pub = n + c.updates;
+    c.aff_batch = make_affiliations(first_aff, BATCH);
+    c.pub_batch = make_publications(first_pub, BATCH, c.affiliations / 2);
+    for ( unsigned int i = 0; i < BATCH; ++i ) {
+        c.ref_batch.push_back({publication_id(first_pub + i), pub(c, i)});
+    }
+
+    //Text file with records of their own
+    std::ofstream text(TEXT_FILE);
+    for ( auto const& a : make_affiliations(first_aff + BATCH, BATCH / 2) ) {
+        text << "A;" << a.id << ";" << a.name << ";" << a.xy.x << ";" << a.xy.y << "\n";
+    }
+    for ( auto const& p : make_publications(first_pub + BATCH, BATCH / 2, c.affiliations / 2) ) {
+        text << "P;" << p.id << ";" << p.name << ";" << p.year << ";";
+        for ( std::size_t j = 0; j < p.affiliations.size(); ++j ) { text << (j ? "," : "") << p.affiliations[j]; }
+        text << "\n";
+    }
+}
+
+// ns per call, or per record for the batch operations
+double measure(Operation const& op, Context& c)
+{
+    if ( op.kind == Kind::query ) {
+        op.call(c, 0);
+        return ns_per_call([&](unsigned int i) { op.call(c, i); }, 1) / op.records;
+    }
+    unsigned int calls = op.kind == Kind::update ? c.updates : 1;
+    auto start = Clock::now();
+    for ( unsigned int i = 0; i < calls; ++i ) { op.call(c, i); }
+    return seconds_since(start) * 1e9 / calls / op.records;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int largest = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+    std::string filter = argc > 2 ? argv[2] : "";
+
+    auto ops = operations();
+    std::vector<double> sizes;
+    std::vector<std::vector<double>> times(ops.size());
+
+    for ( unsigned int n = 1000; n <= largest; n *= 10 ) {
+        std::cerr << "n = " << n << std::endl;
+        rand_engine.seed(n);
+        Context c;
+        prepare(c, n);
+        sizes.push_back(n);
+        for ( std::size_t o = 0; o < ops.size(); ++o ) {
+            if ( std::string(ops[o].name).find(filter) == std::string::npos ) { continue; }
+            times[o].push_back(measure(ops[o], c));
+        }
+    }
+    std::remove(SNAPSHOT_FILE);
+    std::remove(TEXT_FILE);
+
+    std::cout << std::setw(46) << std::left << "ns/call" << std::right;
+    for ( auto n : sizes ) { std::cout << std::setw(12) << static_cast<unsigned int>(n); }
+    std::cout << std::setw(8) << "slope" << std::setw(11) << "measured" << std::setw(11) << "estimate" << std::endl;
+
+    unsigned int flagged = 0;
+    for ( std::size_t o = 0; o < ops.size(); ++o ) {
+        if ( times[o].empty() ) { continue; }
+        Fit fit = fit_growth(sizes, times[o]);
+        bool flag = exceeds(fit, ops[o].documented, sizes);
+        if ( flag ) { ++flagged; }
+
+        std::cout << std::setw(46) << std::left << ops[o].name << std::right << std::fixed << std::setprecision(0);
+        for ( auto t : times[o] ) { std::cout << std::setw(12) << t; }
+        std::cout << std::setw(8) << std::setprecision(2) << fit.slope
+                  << std::setw(11) << growth_name(fit.growth) << std::setw(11) << growth_name(ops[o].documented)
+                  << (flag ? "   EXCEEDS ESTIMATE" : "") << std::endl;
+    }
+
+    std::cout << flagged << " operation(s) exceed their estimate" << std::endl;
+    return flagged == 0 ? 0 : 1;
+}
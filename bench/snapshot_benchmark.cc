@@ -0,0 +1,134 @@
+// Snapshot_benchmark.cc
+//
+// Throughput of reader threads querying while one writer thread ingests new
+// publications. In snapshot mode readers query the latest published
+// Snapshot and the writer publishes every PUBLISH_EVERY additions. In mutex
+// mode everything goes through one std::mutex around the Datastructures, the
+// simplest alternative.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc bench/snapshot_benchmark.cc -o snapshot_benchmark
+//   ./snapshot_benchmark [publications, default 100000] [seconds per run, default 1]
+
+#include "bench/harness.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace harness;
+
+namespace
+{
+const unsigned int PUBLISH_EVERY = 10000;
+const unsigned int PROBES = 1024;
+
+struct Result
+{
+    double reads_per_second = 0;
+    double writes_per_second = 0;
+    unsigned long long publishes = 0;
+};
+
+// Mix of point and small range queries, the same for both modes
+template <typename Store>
+void query(Store const& store, std::vector<PublicationID> const& pubs, std::vector<AffiliationID> const& affs, unsigned int i)
+{
+    switch ( i % 4 ) {
+    case 0: keep(store.get_publication_name(pubs[i % PROBES])); break;
+    case 1: keep(store.get_publications(affs[i % PROBES])); break;
+    case 2: keep(store.get_publications_after(affs[i % PROBES], 2000)); break;
+    default: keep(store.get_affiliations_nearest({5000000, 5000000}, 5)); break;
+    }
+}
+
+Result run(bool snapshots, unsigned int readers, unsigned int n, double seconds)
+{
+    Datastructures ds;
+    rand_engine.seed(n);
+    fill(ds, n / 10, n);
+    ds.publish_snapshot();
+
+    std::vector<PublicationID> pubs;
+    std::vector<AffiliationID> affs;
+    for ( unsigned int i = 0; i < PROBES; ++i ) {
+        pubs.push_back(publication_id(random_in_range(0u, n - 1)));
+        affs.push_back(affiliation_id(random_in_range(0u, n / 10 - 1)));
+    }
+    auto new_pubs = make_publications(n, 500000, n / 10);
+
+    std::mutex lock;
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned long long> reads{0};
+    unsigned long long writes = 0;
+    Result result;
+
+    std::vector<std::thread> threads;
+    for ( unsigned int r = 0; r < readers; ++r ) {
+        threads.emplace_back([&, r]() {
+            unsigned long long done = 0;
+            for ( unsigned int i = r; !stop.load(std::memory_order_relaxed); i += 7 ) {
+                if ( snapshots ) {
+                    //A reader keeps its snapshot for a while, like a request handler would
+                    auto snap = ds.snapshot();
+                    for ( unsigned int j = 0; j < 64; ++j ) { query(*snap, pubs, affs, i + j); }
+                }
+                else {
+                    for ( unsigned int j = 0; j < 64; ++j ) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        query(ds, pubs, affs, i + j);
+                    }
+                }
+                done += 64;
+            }
+            reads += done;
+        });
+    }
+
+    auto start = Clock::now();
+    while ( seconds_since(start) < seconds && writes < new_pubs.size() ) {
+        auto const& p = new_pubs[writes];
+        if ( snapshots ) {
+            ds.add_publication(p.id, p.name, p.year, p.affiliations);
+            if ( ++writes % PUBLISH_EVERY == 0 ) {
+                ds.publish_snapshot();
+                ++result.publishes;
+            }
+        }
+        else {
+            std::lock_guard<std::mutex> guard(lock);
+            ds.add_publication(p.id, p.name, p.year, p.affiliations);
+            ++writes;
+        }
+    }
+    double elapsed = seconds_since(start);
+    stop = true;
+    for ( auto& t : threads ) { t.join(); }
+
+    result.reads_per_second = reads / elapsed;
+    result.writes_per_second = writes / elapsed;
+    return result;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    double seconds = argc > 2 ? std::strtod(argv[2], nullptr) : 1.0;
+
+    std::cout << n << " publications, " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    std::cout << std::setw(10) << "mode" << std::setw(9) << "readers" << std::setw(14) << "reads/s"
+              << std::setw(14) << "writes/s" << std::setw(11) << "publishes" << std::endl;
+    for ( unsigned int readers : {1u, 2u, 4u, 8u} ) {
+        for ( bool snapshots : {false, true} ) {
+            Result r = run(snapshots, readers, n, seconds);
+            std::cout << std::setw(10) << (snapshots ? "snapshot" : "mutex") << std::setw(9) << readers
+                      << std::fixed << std::setprecision(0) << std::setw(14) << r.reads_per_second
+                      << std::setw(14) << r.writes_per_second << std::setw(11) << r.publishes << std::endl;
+        }
+    }
+    return 0;
+}
@@ -9,18 +9,688 @@
 #include <random>
 
 #include <cmath>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <charconv>
+#include <chrono>
+#include <sstream>
+#include <cstdio>
+#include <filesystem>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DATASTRUCTURES_HAVE_MMAP
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DATASTRUCTURES_HAVE_X86_KERNELS
+#endif
+
+//DS_TIME(op) times the rest of the enclosing function, DS_COUNT(counter)
+//bumps a counter. DS_TIME_OF(ds, op) does the same for the stats of ds.
+//All are empty unless DATASTRUCTURES_STATS is defined.
+#ifdef DATASTRUCTURES_STATS
+namespace
+{
+//Only the outermost timer of a thread records, so a public operation that
+//calls other public operations (get_any_path, load_text...) counts once
+class OperationTimer
+{
+public:
+    OperationTimer(DatastructuresStats const& stats, DatastructuresStats::Operation op)
+        : stats_{stats}, op_{op}, outermost_{depth_++ == 0}
+    {
+        if ( outermost_ ) { start_ = std::chrono::steady_clock::now(); }
+    }
+
+    ~OperationTimer()
+    {
+        --depth_;
+        if ( !outermost_ ) { return; }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+        stats_.record(op_, ns.count());
+    }
+
+    OperationTimer(OperationTimer const&) = delete;
+    OperationTimer& operator=(OperationTimer const&) = delete;
+
+private:
+    static thread_local unsigned int depth_;
+
+    DatastructuresStats const& stats_;
+    DatastructuresStats::Operation op_;
+    bool outermost_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+thread_local unsigned int OperationTimer::depth_ = 0;
+}
+#define DS_TIME_OF(ds, op) OperationTimer ds_timer_{*(ds).stats.ptr, DatastructuresStats::op}
+#define DS_TIME(op) DS_TIME_OF(*this, op)
+#define DS_COUNT(counter) stats.ptr->count(DatastructuresStats::counter)
+#else
+#define DS_TIME_OF(ds, op) static_cast<void>(0)
+#define DS_TIME(op) static_cast<void>(0)
+#define DS_COUNT(counter) static_cast<void>(0)
+#endif
 
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
-template <typename Type>
-Type random_in_range(Type start, Type end)
+namespace
+{
+//Swaps c with an empty container on the same allocator, so that all of c's
+//memory has been given back when this returns, unlike with clear().
+template <typename Container>
+void reset_container(Container& c)
+{
+    Container empty(c.get_allocator());
+    c.swap(empty);
+}
+
+//Same for ordered sets, which keep their comparator
+template <typename Key, typename Compare>
+void reset_container(std::pmr::set<Key, Compare>& c)
+{
+    std::pmr::set<Key, Compare> empty(c.key_comp(), c.get_allocator());
+    c.swap(empty);
+}
+
+//Empties c like reset_container, but if c allocates from arena its contents
+//are swapped into a container placed in the arena itself and never
+//destroyed, arena.release() then frees them without visiting an element.
+//Only for containers whose elements own no memory outside the arena.
+//args are the constructor arguments before the allocator (a comparator).
+template <typename Container, typename... Args>
+void drop_container(Container& c, std::pmr::unsynchronized_pool_resource& arena, Args const&... args)
+{
+    if ( c.get_allocator().resource() != &arena ) {
+        reset_container(c);
+        return;
+    }
+    void* place = arena.allocate(sizeof(Container), alignof(Container));
+    Container* dropped = new (place) Container(args..., c.get_allocator());
+    dropped->swap(c);
+}
+
+//Longest AffiliationID that fits in the string object itself
+const std::size_t SHORT_ID_LENGTH = AffiliationID().capacity();
+
+//Squared euclidean distance computed in 64 bits so that any two int
+//coordinates are safe. Saturates in the (extreme) case the sum doesn't fit.
+unsigned long long squared_distance(Coord c1, Coord c2)
+{
+    long long dx = static_cast<long long>(c1.x) - c2.x;
+    long long dy = static_cast<long long>(c1.y) - c2.y;
+    unsigned long long ux = dx < 0 ? -dx : dx;
+    unsigned long long uy = dy < 0 ? -dy : dy;
+    unsigned long long sum = ux*ux + uy*uy;
+    if ( sum < ux*ux ) { return std::numeric_limits<unsigned long long>::max(); }
+    return sum;
+}
+
+//Batch version of squared_distance: out[i] = squared_distance(origin, {xs[i], ys[i]}).
+//The vector versions do the same 64 bit math lane by lane: |dx| fits in
+//32 bits, so the unsigned 32x32->64 multiply is exact, and a sum that
+//wraps around is saturated like above.
+void squared_distances_scalar(Coord origin, int const* xs, int const* ys, std::size_t n, unsigned long long* out)
+{
+    for ( std::size_t i = 0; i < n; ++i ) { out[i] = squared_distance(origin, {xs[i], ys[i]}); }
+}
+
+#ifdef DATASTRUCTURES_HAVE_X86_KERNELS
+__attribute__((target("avx2")))
+void squared_distances_avx2(Coord origin, int const* xs, int const* ys, std::size_t n, unsigned long long* out)
+{
+    const __m256i ox = _mm256_set1_epi64x(origin.x);
+    const __m256i oy = _mm256_set1_epi64x(origin.y);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i high_bit = _mm256_set1_epi64x(std::numeric_limits<long long>::min());
+    std::size_t i = 0;
+    for ( ; i + 4 <= n; i += 4 ) {
+        __m256i dx = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const*>(xs + i))), ox);
+        __m256i dy = _mm256_sub_epi64(_mm256_cvtepi32_epi64(_mm_loadu_si128(reinterpret_cast<__m128i const*>(ys + i))), oy);
+        //abs, there is no 64 bit abs before AVX-512
+        __m256i sx = _mm256_cmpgt_epi64(zero, dx);
+        __m256i sy = _mm256_cmpgt_epi64(zero, dy);
+        dx = _mm256_sub_epi64(_mm256_xor_si256(dx, sx), sx);
+        dy = _mm256_sub_epi64(_mm256_xor_si256(dy, sy), sy);
+        __m256i xx = _mm256_mul_epu32(dx, dx);
+        __m256i sum = _mm256_add_epi64(xx, _mm256_mul_epu32(dy, dy));
+        //Unsigned sum < xx means it wrapped, compared signed with the high bit flipped
+        __m256i wrapped = _mm256_cmpgt_epi64(_mm256_xor_si256(xx, high_bit), _mm256_xor_si256(sum, high_bit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(sum, wrapped));
+    }
+    squared_distances_scalar(origin, xs + i, ys + i, n - i, out + i);
+}
+
+__attribute__((target("sse4.2")))
+void squared_distances_sse42(Coord origin, int const* xs, int const* ys, std::size_t n, unsigned long long* out)
+{
+    const __m128i ox = _mm_set1_epi64x(origin.x);
+    const __m128i oy = _mm_set1_epi64x(origin.y);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i high_bit = _mm_set1_epi64x(std::numeric_limits<long long>::min());
+    std::size_t i = 0;
+    for ( ; i + 2 <= n; i += 2 ) {
+        __m128i dx = _mm_sub_epi64(_mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(xs + i))), ox);
+        __m128i dy = _mm_sub_epi64(_mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(ys + i))), oy);
+        __m128i sx = _mm_cmpgt_epi64(zero, dx);
+        __m128i sy = _mm_cmpgt_epi64(zero, dy);
+        dx = _mm_sub_epi64(_mm_xor_si128(dx, sx), sx);
+        dy = _mm_sub_epi64(_mm_xor_si128(dy, sy), sy);
+        __m128i xx = _mm_mul_epu32(dx, dx);
+        __m128i sum = _mm_add_epi64(xx, _mm_mul_epu32(dy, dy));
+        __m128i wrapped = _mm_cmpgt_epi64(_mm_xor_si128(xx, high_bit), _mm_xor_si128(sum, high_bit));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(sum, wrapped));
+    }
+    squared_distances_scalar(origin, xs + i, ys + i, n - i, out + i);
+}
+#endif
+
+using SquaredDistancesKernel = void (*)(Coord, int const*, int const*, std::size_t, unsigned long long*);
+
+//Picks the widest kernel the cpu running the program supports
+SquaredDistancesKernel choose_squared_distances()
+{
+#ifdef DATASTRUCTURES_HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) { return squared_distances_avx2; }
+    if ( __builtin_cpu_supports("sse4.2") ) { return squared_distances_sse42; }
+#endif
+    return squared_distances_scalar;
+}
+
+void squared_distances(Coord origin, int const* xs, int const* ys, std::size_t n, unsigned long long* out)
+{
+    static const SquaredDistancesKernel kernel = choose_squared_distances();
+    kernel(origin, xs, ys, n, out);
+}
+
+//Three bytes of a name packed into one key
+std::uint32_t trigram(char const* c)
+{
+    return (static_cast<std::uint32_t>(static_cast<unsigned char>(c[0])) << 16)
+            | (static_cast<std::uint32_t>(static_cast<unsigned char>(c[1])) << 8)
+            | static_cast<unsigned char>(c[2]);
+}
+
+//Calls visit(t) once for every distinct trigram t of name
+template <typename Visit>
+void for_each_trigram(std::string_view name, Visit visit)
+{
+    if ( name.size() < 3 ) { return; }
+    std::vector<std::uint32_t> trigrams;
+    trigrams.reserve(name.size() - 2);
+    for ( std::size_t i = 0; i + 3 <= name.size(); ++i ) { trigrams.push_back(trigram(name.data() + i)); }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    for ( auto t : trigrams ) { visit(t); }
+}
+
+unsigned long long grid_key(long long cx, long long cy)
+{
+    return (static_cast<unsigned long long>(static_cast<unsigned int>(cx)) << 32)
+            | static_cast<unsigned int>(cy);
+}
+
+//Snapshot file: header, then sections of (uint64 count, count elements,
+//zero padding to 8 bytes). Native byte order, checked from the header.
+const char SNAPSHOT_MAGIC[8] = {'D', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+const std::uint32_t SNAPSHOT_VERSION = 2;
+const std::uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+//Writes to path + ".tmp" and renames that over path in finish(), so that a
+//failed save leaves the old file as it was. Paths that exist but aren't
+//regular files (devices, pipes) can't be replaced and are written in place.
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::string const& path)
+        : path_{path}, temp_path_{write_in_place(path) ? path : path + ".tmp"},
+          out_{temp_path_, std::ios::binary | std::ios::trunc} {}
+
+    ~SnapshotWriter()
+    {
+        if ( !finished_ && temp_path_ != path_ ) {
+            out_.close();
+            std::remove(temp_path_.c_str());
+        }
+    }
+
+    SnapshotWriter(SnapshotWriter const&) = delete;
+    SnapshotWriter& operator=(SnapshotWriter const&) = delete;
+
+    bool ok() const { return static_cast<bool>(out_); }
+
+    //Flushes and closes the file and moves it in place. False if any write,
+    //the flush, the close or the rename failed, path is then left untouched.
+    bool finish()
+    {
+        finished_ = true;
+        out_.flush();
+        out_.close();
+        bool ok = !out_.fail();
+        if ( temp_path_ != path_ ) {
+            ok = ok && std::rename(temp_path_.c_str(), path_.c_str()) == 0;
+            if ( !ok ) { std::remove(temp_path_.c_str()); }
+        }
+        return ok;
+    }
+
+    void write_raw(void const* data, std::size_t bytes)
+    {
+        out_.write(static_cast<char const*>(data), bytes);
+        written_ += bytes;
+    }
+
+    template <typename T>
+    void write_array(T const* data, std::size_t count)
+    {
+        std::uint64_t n = count;
+        write_raw(&n, sizeof(n));
+        write_raw(data, count * sizeof(T));
+        static const char zeros[8] = {};
+        write_raw(zeros, (8 - written_ % 8) % 8);
+    }
+
+    template <typename T>
+    void write_array(std::vector<T> const& v) { write_array(v.data(), v.size()); }
+
+    //Nested vectors in CSR form: offsets (size n+1) and the values back to back
+    template <typename Lists>
+    void write_csr(Lists const& lists)
+    {
+        std::vector<std::uint64_t> offsets;
+        offsets.reserve(lists.size() + 1);
+        offsets.push_back(0);
+        std::vector<std::remove_cv_t<std::remove_reference_t<decltype(*lists[0].begin())>>> values;
+        for ( std::size_t i = 0; i < lists.size(); ++i ) {
+            values.insert(values.end(), lists[i].begin(), lists[i].end());
+            offsets.push_back(values.size());
+        }
+        write_array(offsets);
+        write_array(values);
+    }
+
+    //Node map of vectors (the grid, the trigram index) as its keys and the
+    //vectors in CSR form, in the map's own order
+    template <typename Map>
+    void write_buckets(Map const& map)
+    {
+        std::vector<typename Map::key_type> keys;
+        keys.reserve(map.size());
+        std::vector<std::uint64_t> offsets;
+        offsets.reserve(map.size() + 1);
+        offsets.push_back(0);
+        std::vector<typename Map::mapped_type::value_type> values;
+        for ( auto const& bucket : map ) {
+            keys.push_back(bucket.first);
+            values.insert(values.end(), bucket.second.begin(), bucket.second.end());
+            offsets.push_back(values.size());
+        }
+        write_array(keys);
+        write_array(offsets);
+        write_array(values);
+    }
+
+private:
+    static bool write_in_place(std::string const& path)
+    {
+        std::error_code error;
+        auto status = std::filesystem::status(path, error);
+        return std::filesystem::exists(status) && !std::filesystem::is_regular_file(status);
+    }
+
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    std::size_t written_ = 0;
+    bool finished_ = false;
+};
+
+//Read-only mapping of a whole file. Falls back to reading the file into
+//memory where mmap isn't available.
+class MappedFile
+{
+public:
+    explicit MappedFile(std::string const& path)
+    {
+#ifdef DATASTRUCTURES_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if ( fd < 0 ) { return; }
+        struct stat st;
+        if ( ::fstat(fd, &st) == 0 && st.st_size > 0 ) {
+            void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( p != MAP_FAILED ) {
+                data_ = static_cast<char const*>(p);
+                size_ = st.st_size;
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary);
+        buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef DATASTRUCTURES_HAVE_MMAP
+        if ( data_ ) { ::munmap(const_cast<char*>(data_), size_); }
+#endif
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    char const* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    char const* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifndef DATASTRUCTURES_HAVE_MMAP
+    std::vector<char> buffer_;
+#endif
+};
+
+//Counterpart of SnapshotWriter. Every read checks the remaining size,
+//false means the file is truncated or otherwise broken.
+class SnapshotReader
+{
+public:
+    SnapshotReader(char const* data, std::size_t size) : data_{data}, size_{size} {}
+
+    bool read_raw(void* out, std::size_t bytes)
+    {
+        if ( bytes > size_ - pos_ ) { return false; }
+        std::memcpy(out, data_ + pos_, bytes);
+        pos_ += bytes;
+        return true;
+    }
+
+    template <typename T>
+    bool read_array(std::vector<T>& v)
+    {
+        std::uint64_t n = 0;
+        if ( !read_raw(&n, sizeof(n)) || n > (size_ - pos_) / sizeof(T) ) { return false; }
+        v.resize(n);
+        //An empty vector's data() may be null, which memcpy must not get
+        if ( n > 0 && !read_raw(v.data(), n * sizeof(T)) ) { return false; }
+        pos_ = std::min(size_, pos_ + (8 - pos_ % 8) % 8);
+        return true;
+    }
+
+    template <typename T>
+    bool read_array(std::vector<T>& v, std::size_t expected)
+    {
+        return read_array(v) && v.size() == expected;
+    }
+
+    //Section as a pointer into the file, nothing copied. Sections start at
+    //multiples of 8 bytes from an aligned start, so T is aligned.
+    template <typename T>
+    bool read_view(T const*& first, std::size_t& count)
+    {
+        std::uint64_t n = 0;
+        if ( !read_raw(&n, sizeof(n)) || n > (size_ - pos_) / sizeof(T) ) { return false; }
+        first = reinterpret_cast<T const*>(data_ + pos_);
+        count = n;
+        pos_ += n * sizeof(T);
+        pos_ = std::min(size_, pos_ + (8 - pos_ % 8) % 8);
+        return true;
+    }
+
+    //Offsets and values of count lists in CSR form, every value must pass valid(value)
+    template <typename T, typename Valid>
+    bool read_csr(std::uint64_t const*& offsets, T const*& values, std::size_t count, Valid valid)
+    {
+        std::size_t offset_count = 0;
+        std::size_t value_count = 0;
+        if ( !read_view(offsets, offset_count) || offset_count != count + 1 || !read_view(values, value_count) ) { return false; }
+        if ( offsets[0] != 0 || offsets[count] != value_count ) { return false; }
+        for ( std::size_t i = 0; i < count; ++i ) {
+            if ( offsets[i] > offsets[i + 1] ) { return false; }
+        }
+        return std::all_of(values, values + value_count, valid);
+    }
+
+    //count lists straight into a ListPool
+    template <typename T, unsigned int N, typename Valid>
+    bool read_csr(ListPool<T, N>& lists, std::size_t count, Valid valid)
+    {
+        std::uint64_t const* offsets = nullptr;
+        T const* values = nullptr;
+        if ( !read_csr(offsets, values, count, valid) ) { return false; }
+        lists.assign(offsets, values, count);
+        return true;
+    }
+
+    //Counterpart of SnapshotWriter::write_buckets, map must be empty
+    template <typename Map, typename Valid>
+    bool read_buckets(Map& map, Valid valid)
+    {
+        typename Map::key_type const* keys = nullptr;
+        std::size_t count = 0;
+        std::uint64_t const* offsets = nullptr;
+        typename Map::mapped_type::value_type const* values = nullptr;
+        if ( !read_view(keys, count) || !read_csr(offsets, values, count, valid) ) { return false; }
+        map.reserve(count);
+        for ( std::size_t i = 0; i < count; ++i ) {
+            if ( !map.emplace(keys[i], typename Map::mapped_type(values + offsets[i], values + offsets[i + 1])).second ) { return false; }
+        }
+        return true;
+    }
+
+private:
+    char const* data_;
+    std::size_t size_;
+    std::size_t pos_ = 0;
+};
+
+//load_text reads the file this much at a time
+const std::size_t LOAD_CHUNK_SIZE = 4 << 20;
+
+//Records parsed from one piece of a chunk
+struct ParsedRecords
+{
+    std::vector<AffiliationRecord> affiliations;
+    std::vector<PublicationRecord> publications;
+    std::vector<ReferenceRecord> references;
+    std::vector<char> kinds;  // 'A', 'P' or 'R' for every record, in file order
+    std::size_t lines = 0;
+    std::size_t bad_lines = 0;
+};
+
+//Splits line at ';' into at most max_fields fields, the last one gets the rest
+std::size_t split_fields(std::string_view line, std::string_view* fields, std::size_t max_fields)
+{
+    std::size_t n = 0;
+    while ( n + 1 < max_fields ) {
+        auto pos = line.find(';');
+        if ( pos == std::string_view::npos ) { break; }
+        fields[n++] = line.substr(0, pos);
+        line.remove_prefix(pos + 1);
+    }
+    fields[n++] = line;
+    return n;
+}
+
+template <typename T>
+bool parse_number(std::string_view text, T& value)
+{
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool parse_line(std::string_view line, ParsedRecords& out)
+{
+    std::string_view f[5];
+    std::size_t n = split_fields(line, f, 5);
+
+    if ( f[0] == "A" && n == 5 ) {
+        Coord xy;
+        if ( f[1].empty() || !parse_number(f[3], xy.x) || !parse_number(f[4], xy.y) ) { return false; }
+        out.affiliations.push_back({AffiliationID(f[1]), Name(f[2]), xy});
+        out.kinds.push_back('A');
+        return true;
+    }
+    if ( f[0] == "P" && (n == 4 || n == 5) ) {
+        PublicationRecord p;
+        if ( !parse_number(f[1], p.id) || !parse_number(f[3], p.year) ) { return false; }
+        p.name = f[2];
+        if ( n == 5 ) {
+            for ( std::string_view rest = f[4]; !rest.empty(); ) {
+                auto pos = rest.find(',');
+                auto id = rest.substr(0, pos);
+                if ( !id.empty() ) { p.affiliations.emplace_back(id); }
+                rest.remove_prefix(pos == std::string_view::npos ? rest.size() : pos + 1);
+            }
+        }
+        out.publications.push_back(std::move(p));
+        out.kinds.push_back('P');
+        return true;
+    }
+    if ( f[0] == "R" && n == 3 ) {
+        ReferenceRecord r;
+        if ( !parse_number(f[1], r.first) || !parse_number(f[2], r.second) ) { return false; }
+        out.references.push_back(r);
+        out.kinds.push_back('R');
+        return true;
+    }
+    return false;
+}
+
+void parse_lines(std::string_view text, ParsedRecords& out)
+{
+    while ( !text.empty() ) {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if ( !line.empty() && line.back() == '\r' ) { line.remove_suffix(1); }
+
+        ++out.lines;
+        if ( line.empty() || line[0] == '#' ) { continue; }
+        if ( !parse_line(line, out) ) { ++out.bad_lines; }
+    }
+}
+
+//Below this many elements threads cost more than they save
+const std::size_t PARALLEL_SORT_MIN = 1 << 16;
+
+//std::sort split over the hardware threads: every thread sorts one chunk,
+//then neighbouring chunks are merged pairwise, also in parallel.
+template <typename Iter>
+void parallel_sort(Iter first, Iter last)
 {
-    auto range = end-start;
-    ++range;
+    const std::size_t n = last - first;
+    std::size_t threads = std::thread::hardware_concurrency();
+    if ( n < PARALLEL_SORT_MIN || threads < 2 ) {
+        std::sort(first, last);
+        return;
+    }
+    threads = std::min(threads, n / (PARALLEL_SORT_MIN / 2));
+
+    std::vector<Iter> bounds;
+    for ( std::size_t i = 0; i <= threads; ++i ) { bounds.push_back(first + n * i / threads); }
+
+    std::vector<std::thread> workers;
+    for ( std::size_t i = 0; i < threads; ++i ) {
+        workers.emplace_back([&bounds, i]() { std::sort(bounds[i], bounds[i + 1]); });
+    }
+    for ( auto& w : workers ) { w.join(); }
+
+    //Each round halves the number of sorted runs
+    while ( bounds.size() > 2 ) {
+        workers.clear();
+        std::vector<Iter> merged;
+        std::size_t i = 0;
+        for ( ; i + 2 < bounds.size(); i += 2 ) {
+            Iter a = bounds[i], b = bounds[i + 1], c = bounds[i + 2];
+            workers.emplace_back([a, b, c]() { std::inplace_merge(a, b, c); });
+            merged.push_back(a);
+        }
+        for ( ; i < bounds.size(); ++i ) { merged.push_back(bounds[i]); }
+        for ( auto& w : workers ) { w.join(); }
+        bounds = std::move(merged);
+    }
+}
+
+const std::size_t PARALLEL_FOR_MIN = 1 << 14;
 
-    auto num = std::uniform_int_distribution<unsigned long int>(0, range-1)(rand_engine);
+//Calls body(begin, end, t) for consecutive chunks of [0, n), chunk t on
+//thread t, in rounds. After every round between(chunks) runs alone on the
+//calling thread, the next round starts if it returns true. The threads are
+//started once and wait for the next round on a condition variable, so a
+//round costs a wakeup instead of a thread start. Small inputs are one chunk.
+template <typename Body, typename Between>
+void parallel_rounds(std::size_t n, std::size_t threads, Body body, Between between)
+{
+    threads = std::max<std::size_t>(1, std::min(threads, n / PARALLEL_FOR_MIN));
+    auto chunk = [&](std::size_t t) { body(n * t / threads, n * (t + 1) / threads, t); };
+    if ( threads == 1 ) {
+        do { chunk(0); } while ( between(std::size_t(1)) );
+        return;
+    }
+
+    std::mutex lock;
+    std::condition_variable round_started;
+    std::condition_variable chunk_finished;
+    std::size_t round = 0;
+    std::size_t finished = 0;
+    bool stop = false;
+
+    //Chunk 0 is done by the calling thread
+    std::vector<std::thread> workers;
+    for ( std::size_t t = 1; t < threads; ++t ) {
+        workers.emplace_back([&, t]()
+        {
+            for ( std::size_t done = 0; ; ++done ) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    round_started.wait(guard, [&]() { return stop || round > done; });
+                    if ( stop ) { return; }
+                }
+                chunk(t);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    ++finished;
+                }
+                chunk_finished.notify_one();
+            }
+        });
+    }
 
-    return static_cast<Type>(start+num);
+    do {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            ++round;
+            finished = 0;
+        }
+        round_started.notify_all();
+        chunk(0);
+        std::unique_lock<std::mutex> guard(lock);
+        chunk_finished.wait(guard, [&]() { return finished == threads - 1; });
+    } while ( between(threads) );
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    round_started.notify_all();
+    for ( auto& w : workers ) { w.join(); }
+}
 }
 
 // Modify the code below to implement the functionality of the class.
@@ -38,309 +708,615 @@ Datastructures::~Datastructures()
 
 }
 
-unsigned int Datastructures::get_affiliation_count()
+std::shared_ptr<const Snapshot> Datastructures::snapshot() const
+{
+    DS_TIME(snapshot);
+    return std::atomic_load(&current_snapshot.ptr);
+}
+
+void Datastructures::publish_snapshot()
+{
+    DS_TIME(publish_snapshot);
+    //Bring every lazily updated table up to date so that the snapshot
+    //can answer all queries without writing anything.
+    ancestors_update();
+    intervals_update();
+    view_all_affiliations();
+    view_all_publications();
+
+    //The snapshot before the current one can only be reused if nobody can
+    //reach it any more. The fence pairs with the release of the last reader's
+    //reference, so its reads are over before anything is written.
+    std::shared_ptr<Snapshot> snap = std::move(update_log.spare);
+    if ( snap && snap.use_count() == 1 && !update_log.previous_lost && !update_log.current_lost ) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        DS_COUNT(snapshot_replays);
+        Datastructures& data = snap->data_;
+#ifdef DATASTRUCTURES_STATS
+        //Replayed updates aren't queries on the snapshot
+        data.stats.ptr = std::make_shared<DatastructuresStats>();
+#endif
+        for ( auto& update : update_log.previous ) { update(data); }
+        for ( auto& update : update_log.current ) { update(data); }
+        //Handles and slots are the same as here, so tables that the updates
+        //made out of date there are the same as the ones just updated here
+        if ( !data.ancestors_valid ) {
+            data.lift = lift;
+            data.pub_depth = pub_depth;
+            data.ancestors_valid = true;
+        }
+        if ( !data.intervals_valid ) {
+            data.dfs_order = dfs_order;
+            data.pre_order = pre_order;
+            data.subtree_end = subtree_end;
+            data.intervals_valid = true;
+        }
+        if ( !data.affIDList_valid ) {
+            data.affIDList = affIDList;
+            data.aff_list_pos = aff_list_pos;
+            data.affIDList_valid = true;
+        }
+        if ( !data.pubIDList_valid ) {
+            data.pubIDList = pubIDList;
+            data.pub_list_pos = pub_list_pos;
+            data.pubIDList_valid = true;
+        }
+#ifdef DATASTRUCTURES_STATS
+        data.stats.ptr = stats.ptr;
+#endif
+    }
+    else {
+        DS_COUNT(snapshot_copies);
+        snap = std::make_shared<Snapshot>(*this);
+    }
+
+    std::shared_ptr<const Snapshot> published = snap;
+    published = std::atomic_exchange(&current_snapshot.ptr, published);
+    //Created without const, so it may be written again once unused. The
+    //first publish makes a second copy so that the next one needn't copy.
+    if ( published ) { update_log.spare = std::const_pointer_cast<Snapshot>(published); }
+    else { update_log.spare = std::make_shared<Snapshot>(*this); }
+    update_log.previous = std::move(update_log.current);
+    update_log.current.clear();
+    update_log.current_records = 0;
+    update_log.previous_lost = update_log.current_lost;
+    update_log.current_lost = false;
+    update_log.on = true;
+}
+
+template <typename Update>
+void Datastructures::log_update(std::size_t records, Update&& update)
+{
+    if ( !update_log.on || update_log.current_lost ) { return; }
+    //Past the size of the store copying it is cheaper than applying the log
+    update_log.current_records += records;
+    if ( update_log.current_records > aff_handles.size() + publications_map.size() + 64 ) {
+        log_lost();
+        return;
+    }
+    update_log.current.emplace_back(std::forward<Update>(update));
+}
+
+void Datastructures::log_lost()
+{
+    if ( !update_log.on ) { return; }
+    update_log.current.clear();
+    update_log.current.shrink_to_fit();
+    update_log.current_lost = true;
+}
+
+Snapshot::Snapshot(const Datastructures &ds)
+    : data_{ds}
+{
+#ifdef DATASTRUCTURES_STATS
+    //Queries on the snapshot are reported in the stats of ds
+    data_.stats.ptr = ds.stats.ptr;
+#endif
+}
+
+Datastructures::NameStore::NameStore(std::pmr::memory_resource* resource)
+    : affs_by_name{Order{this, &NameStore::affs}, resource}, pubs_by_name{Order{this, &NameStore::pubs}, resource}
+{
+
+}
+
+Datastructures::NameStore::NameStore(const NameStore &other)
+    : pool{other.pool}, affs{other.affs}, pubs{other.pubs},
+      affs_by_name{Order{this, &NameStore::affs}}, pubs_by_name{Order{this, &NameStore::pubs}}
+{
+    refill(other);
+}
+
+Datastructures::NameStore &Datastructures::NameStore::operator=(const NameStore &other)
+{
+    if ( this == &other ) { return *this; }
+    pool = other.pool;
+    affs = other.affs;
+    pubs = other.pubs;
+    refill(other);
+    return *this;
+}
+
+Datastructures::NameStore &Datastructures::NameStore::operator=(NameStore &&other)
+{
+    if ( this == &other ) { return *this; }
+    //other's indexes are only walked, never compared, so moving its names out first is fine
+    pool = std::move(other.pool);
+    affs = std::move(other.affs);
+    pubs = std::move(other.pubs);
+    refill(other);
+    other.affs_by_name.clear();
+    other.pubs_by_name.clear();
+    return *this;
+}
+
+void Datastructures::NameStore::refill(const NameStore &other)
+{
+    //Comparators stay bound to this, the elements come in order so every insert is at the end
+    affs_by_name.clear();
+    pubs_by_name.clear();
+    for ( auto h : other.affs_by_name ) { affs_by_name.emplace_hint(affs_by_name.end(), h); }
+    for ( auto s : other.pubs_by_name ) { pubs_by_name.emplace_hint(pubs_by_name.end(), s); }
+}
+
+unsigned int Datastructures::get_affiliation_count() const
 {
-    return affIDList.size();
+    DS_TIME(get_affiliation_count);
+    return aff_handles.size();
 }
 
 void Datastructures::clear_all()
 {
-    affIDList.clear();
-    affiliations_map.clear();
+    DS_TIME(clear_all);
+    log_update(1, [](Datastructures& ds) { ds.clear_all(); });
+    //Containers in the arena are left to it and go with the release below.
+    //ID strings with heap memory of their own are destroyed one by one.
+    if ( long_ids.seen ) {
+        reset_container(aff_handles);
+        reset_container(aff_ids);
+        reset_container(affIDList);
+        long_ids.seen = false;
+    }
+    else {
+        drop_container(aff_handles, arena.pool);
+        drop_container(aff_ids, arena.pool);
+        drop_container(affIDList, arena.pool);
+    }
+    drop_container(names.affs_by_name, arena.pool, names.affs_by_name.key_comp());
+    drop_container(names.pubs_by_name, arena.pool, names.pubs_by_name.key_comp());
+    drop_container(affs_by_distance, arena.pool);
+    drop_container(pub_trigrams, arena.pool);
+    drop_container(grid, arena.pool);
+    arena.pool.release();
+
+    //The rest holds plain values, clearing it doesn't visit the elements
+    aff_x.clear();
+    aff_y.clear();
+    names.affs.clear();
+    aff_pubs.clear();
+    aff_pub_pos.clear();
+    aff_list_pos.clear();
+    aff_years.clear();
+    aff_links.clear();
+    link_pos.clear();
+    year_tree.clear();
+    free_handles.clear();
     pubIDList.clear();
     publications_map.clear();
+    pub_ids.clear();
+    pub_years.clear();
+    pub_parents.clear();
+    names.pubs.clear();
+    pub_affs.clear();
+    pub_aff_pos.clear();
+    pub_list_pos.clear();
+    pub_refs.clear();
+    pub_ref_pos.clear();
+    free_slots.clear();
+    lift.assign(1, {});
+    pub_depth.clear();
+    ancestors_valid = true;
+    dfs_order.clear();
+    pre_order.clear();
+    subtree_end.clear();
+    intervals_valid = true;
+    names.pool.clear();
+    affIDList_valid = true;
+    pubIDList_valid = true;
     coord_to_id_map.clear();
+    pub_trigram_entries = 0;
+    pub_trigram_garbage = 0;
+    grid_rebuild();
 }
 
 std::vector<AffiliationID> Datastructures::get_all_affiliations()
 {
-    return affIDList;
+    DS_TIME(get_all_affiliations);
+    auto v = view_all_affiliations();
+    return {v.begin(), v.end()};
+}
+
+ListView<AffiliationID> Datastructures::view_all_affiliations()
+{
+    DS_TIME(view_all_affiliations);
+    //Rebuild the output cache only if a removal has invalidated it
+    if ( affIDList_valid ) { DS_COUNT(affIDList_hits); }
+    else {
+        DS_COUNT(affIDList_rebuilds);
+        affIDList.clear();
+        affIDList.reserve(aff_handles.size());
+        for ( const auto& a : aff_handles ) {
+            aff_list_pos[a.second] = affIDList.size();
+            affIDList.push_back(a.first);
+        }
+        affIDList_valid = true;
+    }
+    return {affIDList.data(), affIDList.data() + affIDList.size()};
 }
 
 bool Datastructures::add_affiliation(AffiliationID id, const Name &name, Coord xy)
 {
-    if ( std::find(affIDList.begin(), affIDList.end(), id) != affIDList.end() ) {
+    DS_TIME(add_affiliation);
+    log_update(1, [id, name, xy](Datastructures& ds) { ds.add_affiliation(id, name, xy); });
+    if ( aff_handles.find(id) != aff_handles.end() ) {
         return false;
     }
 
     // Initialize
-    affIDList.push_back(id);
-    AffiliationData newAff;
-    newAff.name = name;
-    newAff.coords = xy;
-    affiliations_map.insert({id, newAff});
-    coord_to_id_map[xy] = id;
-    alphabetical = false;
-    distance_increasing = false;
+    AffHandle h = new_handle(id);
+    list_affiliation(h);
+    aff_x[h] = xy.x;
+    aff_y[h] = xy.y;
+    names.affs[h] = store_name(name);
+    coord_to_id_map[xy] = h;
+    grid_insert(h, xy);
+    names.affs_by_name.insert(h);
+    affs_by_distance.insert({squared_distance(xy, {0, 0}), xy.y, h});
     return true;
 }
 
-Name Datastructures::get_affiliation_name(AffiliationID id)
+Name Datastructures::get_affiliation_name(AffiliationID id) const
 {
-    auto i = affiliations_map.find(id);
-    if (i == affiliations_map.end()) {
+    DS_TIME(get_affiliation_name);
+    AffHandle h = find_handle(id);
+    if (h == NO_HANDLE) {
         return NO_NAME;
     }
-    return i->second.name;
+    return Name(name_of(names.affs[h]));
 }
 
-Coord Datastructures::get_affiliation_coord(AffiliationID id)
+Coord Datastructures::get_affiliation_coord(AffiliationID id) const
 {
-    auto i = affiliations_map.find(id);
-    if (i == affiliations_map.end()) {
+    DS_TIME(get_affiliation_coord);
+    AffHandle h = find_handle(id);
+    if (h == NO_HANDLE) {
         return NO_COORD;
     }
-    return i->second.coords;
+    return aff_coord(h);
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically()
+std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically() const
 {
-    //Not re-sorting if already in correct order.
-    if ( alphabetical ) { return affIDList; }
-
-    const auto& a = affiliations_map;
-    std::sort(affIDList.begin(), affIDList.end(),
-              [&a](auto const& i1, auto const& i2)
-              { return (a.at(i1).name < a.at(i2).name); });
-
-    //Update flags
-    alphabetical = true;
-    distance_increasing = false;
-
-    return affIDList;
+    DS_TIME(get_affiliations_alphabetically);
+    std::vector<AffiliationID> sorted;
+    sorted.reserve(names.affs_by_name.size());
+    for ( auto h : names.affs_by_name ) { sorted.push_back(aff_ids[h]); }
+    return sorted;
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing()
+std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing() const
 {
-    //Not re-sorting if already in correct order.
-    if ( distance_increasing ) { return affIDList; }
-
-    const auto& a = affiliations_map;
-    std::sort(affIDList.begin(), affIDList.end(),
-              [&a](auto const& i1, auto const& i2)
-    {
-        Coord coord1 = a.at(i1).coords;
-        Coord coord2 = a.at(i2).coords;
-
-        //d = sqrt(x^2+y^2) -> d^2=x^2+y^2 (Euclidian distance)
-        //Non-squared distances suffice in the comparison. (for efficiency)
-
-        int dist1 = coord1.x * coord1.x + coord1.y * coord1.y;
-        int dist2 = coord2.x * coord2.x + coord2.y * coord2.y;
+    DS_TIME(get_affiliations_distance_increasing);
+    //d = sqrt(x^2+y^2) -> d^2=x^2+y^2 (Euclidian distance)
+    //Index is keyed by the squared distance, ties by y coordinate.
+    std::vector<AffiliationID> sorted;
+    sorted.reserve(affs_by_distance.size());
+    for ( const auto& a : affs_by_distance ) { sorted.push_back(aff_ids[std::get<2>(a)]); }
+    return sorted;
+}
 
-        if ( dist1 != dist2 ) { return dist1 < dist2; }
-        return coord1.y < coord2.y; });
+std::vector<AffiliationID> Datastructures::get_affiliations_alphabetically(unsigned int offset, unsigned int count) const
+{
+    DS_TIME(get_affiliations_alphabetically_paged);
+    std::vector<AffiliationID> page;
+    if ( offset >= names.affs_by_name.size() ) { return page; }
+
+    page.reserve(std::min<std::size_t>(count, names.affs_by_name.size() - offset));
+    auto it = std::next(names.affs_by_name.begin(), offset);
+    for ( ; it != names.affs_by_name.end() && page.size() < count; ++it ) { page.push_back(aff_ids[*it]); }
+    return page;
+}
 
-    //Update flags
-    alphabetical = false;
-    distance_increasing = true;
+std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing_from(Coord xy) const
+{
+    DS_TIME(get_affiliations_distance_increasing_from);
+    //One kernel pass straight over the coordinate columns, removed handles
+    //are computed too and dropped afterwards
+    std::vector<unsigned long long> all(aff_ids.size());
+    squared_distances(xy, aff_x.data(), aff_y.data(), aff_ids.size(), all.data());
+
+    std::vector<AffHandle> handles;
+    std::vector<unsigned long long> dist;
+    handles.reserve(aff_handles.size());
+    dist.reserve(aff_handles.size());
+    for ( AffHandle h = 0; h < aff_ids.size(); ++h ) {
+        if ( aff_ids[h] == NO_AFFILIATION ) { continue; }
+        handles.push_back(h);
+        dist.push_back(all[h]);
+    }
+    return sort_by_distance(handles, dist, handles.size());
+}
 
-    return affIDList;
+std::vector<AffiliationID> Datastructures::get_affiliations_distance_increasing(unsigned int offset, unsigned int count) const
+{
+    DS_TIME(get_affiliations_distance_increasing_paged);
+    std::vector<AffiliationID> page;
+    if ( offset >= affs_by_distance.size() ) { return page; }
+
+    page.reserve(std::min<std::size_t>(count, affs_by_distance.size() - offset));
+    auto it = std::next(affs_by_distance.begin(), offset);
+    for ( ; it != affs_by_distance.end() && page.size() < count; ++it ) { page.push_back(aff_ids[std::get<2>(*it)]); }
+    return page;
 }
 
-AffiliationID Datastructures::find_affiliation_with_coord(Coord xy)
+AffiliationID Datastructures::find_affiliation_with_coord(Coord xy) const
 {
+    DS_TIME(find_affiliation_with_coord);
     auto i = coord_to_id_map.find(xy);
     if (i == coord_to_id_map.end()) { return NO_AFFILIATION; }
 
-    return i->second;
+    return aff_ids[i->second];
 
    // Other version in case:
-   // for ( const auto& a : affiliations_map ) {
-   //     if ( a.second.coords == xy ) { return a.first; }
+   // for ( AffHandle h = 0; h < aff_x.size(); ++h ) {
+   //     if ( aff_coord(h) == xy ) { return aff_ids[h]; }
    // }
    // return NO_AFFILIATION;
 }
 
 bool Datastructures::change_affiliation_coord(AffiliationID id, Coord newcoord)
 {
-    //Deleting old from coord_to_id_map and changing .coords to affiliations_map
-    auto i = affiliations_map.find(id);
-    if (i == affiliations_map.end()) { return false; }
-    auto xy = i->second.coords;
-    i->second.coords = newcoord;
+    DS_TIME(change_affiliation_coord);
+    log_update(1, [id, newcoord](Datastructures& ds) { ds.change_affiliation_coord(id, newcoord); });
+    //Deleting old from coord_to_id_map and changing the coordinate columns
+    AffHandle h = find_handle(id);
+    if (h == NO_HANDLE) { return false; }
+    auto xy = aff_coord(h);
+    aff_x[h] = newcoord.x;
+    aff_y[h] = newcoord.y;
     auto i2 = coord_to_id_map.find(xy);
-    coord_to_id_map.erase(i2);
-    coord_to_id_map[newcoord] = id;
+    if ( i2 != coord_to_id_map.end() && i2->second == h ) { coord_to_id_map.erase(i2); }
+    coord_to_id_map[newcoord] = h;
+    grid_erase(h, xy);
+    grid_insert(h, newcoord);
 
-    distance_increasing = false;
+    affs_by_distance.erase({squared_distance(xy, {0, 0}), xy.y, h});
+    affs_by_distance.insert({squared_distance(newcoord, {0, 0}), newcoord.y, h});
     return true;
 }
 
 bool Datastructures::add_publication(PublicationID id, const Name &name, Year year, const std::vector<AffiliationID> &affiliations)
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) != pubIDList.end() ) {
+    DS_TIME(add_publication);
+    log_update(1, [id, name, year, affiliations](Datastructures& ds) { ds.add_publication(id, name, year, affiliations); });
+    if ( publications_map.find(id) != publications_map.end() ) {
         return false;
     }
 
+    //Every affiliation has to exist before anything is modified
+    std::vector<AffHandle> handles;
+    handles.reserve(affiliations.size());
     for ( const auto& a : affiliations ) {
-        affiliations_map.at(a).related_pubs.push_back(id);
+        AffHandle h = find_handle(a);
+        if ( h == NO_HANDLE ) { return false; }
+        handles.push_back(h);
     }
 
     //Initialize
-    pubIDList.push_back(id);
-    PublicationData newPub;
-    newPub.name = name;
-    newPub.year = year;
-    newPub.parent = NO_PUBLICATION;
-    publications_map.insert({id, newPub});
+    PubSlot s = new_slot(id);
+    list_publication(s);
+    pub_years[s] = year;
+    year_tree_add(year, 1);
+    names.pubs[s] = store_name(name);
+    index_publication_name(s);
+    for ( auto h : handles ) { link_affiliation(h, s); }
 
     return true;
 }
 
 std::vector<PublicationID> Datastructures::all_publications()
 {
-    return pubIDList;
+    DS_TIME(all_publications);
+    auto v = view_all_publications();
+    return {v.begin(), v.end()};
+}
+
+ListView<PublicationID> Datastructures::view_all_publications()
+{
+    DS_TIME(view_all_publications);
+    //Rebuild the output cache only if a removal has invalidated it
+    if ( pubIDList_valid ) { DS_COUNT(pubIDList_hits); }
+    else {
+        DS_COUNT(pubIDList_rebuilds);
+        pubIDList.clear();
+        pubIDList.reserve(publications_map.size());
+        for ( const auto& p : publications_map ) {
+            pub_list_pos[p.second] = pubIDList.size();
+            pubIDList.push_back(p.first);
+        }
+        pubIDList_valid = true;
+    }
+    return {pubIDList.data(), pubIDList.data() + pubIDList.size()};
 }
 
-Name Datastructures::get_publication_name(PublicationID id)
+Name Datastructures::get_publication_name(PublicationID id) const
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
+    DS_TIME(get_publication_name);
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) {
         return NO_NAME;
     }
 
-    return publications_map.at(id).name;
+    return Name(name_of(names.pubs[s]));
 }
 
-Year Datastructures::get_publication_year(PublicationID id)
+Year Datastructures::get_publication_year(PublicationID id) const
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
+    DS_TIME(get_publication_year);
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) {
         return NO_YEAR;
     }
 
-    return publications_map.at(id).year;
+    return pub_years[s];
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id)
+std::vector<AffiliationID> Datastructures::get_affiliations(PublicationID id) const
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
-        std::vector<AffiliationID> v;
-        v.push_back(NO_AFFILIATION);
-        return v;
+    DS_TIME(get_affiliations);
+    auto v = view_affiliations(id);
+    if ( !v.found() ) {
+        return {NO_AFFILIATION};
     }
-    return publications_map.at(id).related_affs;
+    return {v.begin(), v.end()};
+}
+
+MappedListView<Datastructures::AffHandle, AffiliationID> Datastructures::view_affiliations(PublicationID id) const
+{
+    DS_TIME(view_affiliations);
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) { return {}; }
+    return {pub_affs[s], aff_ids};
 }
 
 bool Datastructures::add_reference(PublicationID id, PublicationID parentid)
 {
+    DS_TIME(add_reference);
+    log_update(1, [id, parentid](Datastructures& ds) { ds.add_reference(id, parentid); });
     //Can't add reference, if either ID doesn't have a publication.
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
+    PubSlot child = find_slot(id);
+    if ( child == NO_SLOT ) {
         return false; }
 
-    if ( std::find(pubIDList.begin(), pubIDList.end(), parentid) == pubIDList.end() ) {
+    PubSlot parent = find_slot(parentid);
+    if ( parent == NO_SLOT ) {
         return false; }
 
-    publications_map.at(parentid).references.push_back(id);
-    publications_map.at(id).parent = parentid;
-    return true;
-
+    return link_reference(child, parent);
 }
 
-std::vector<PublicationID> Datastructures::get_direct_references(PublicationID id)
+std::vector<PublicationID> Datastructures::get_direct_references(PublicationID id) const
 {
-
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
-        std::vector<PublicationID> reference_IDs;
-        reference_IDs.push_back(NO_PUBLICATION);
-        return reference_IDs;
+    DS_TIME(get_direct_references);
+    auto v = view_direct_references(id);
+    if ( !v.found() ) {
+        return {NO_PUBLICATION};
     }
+    return {v.begin(), v.end()};
+}
 
-    return publications_map.at(id).references;
+MappedListView<Datastructures::PubSlot, PublicationID> Datastructures::view_direct_references(PublicationID id) const
+{
+    DS_TIME(view_direct_references);
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) { return {}; }
+    return {pub_refs[s], pub_ids};
 }
 
 bool Datastructures::add_affiliation_to_publication(AffiliationID affiliationid, PublicationID publicationid)
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), publicationid) == pubIDList.end() ) {
+    DS_TIME(add_affiliation_to_publication);
+    log_update(1, [affiliationid, publicationid](Datastructures& ds) { ds.add_affiliation_to_publication(affiliationid, publicationid); });
+    PubSlot s = find_slot(publicationid);
+    if ( s == NO_SLOT ) {
         return false; }
 
-    if ( std::find(affIDList.begin(), affIDList.end(), affiliationid) == affIDList.end() ) {
+    AffHandle h = find_handle(affiliationid);
+    if ( h == NO_HANDLE ) {
         return false; }
 
     //Add publication and affiliation to eachother.
-    affiliations_map.at(affiliationid).related_pubs.push_back(publicationid);
-    publications_map.at(publicationid).related_affs.push_back(affiliationid);
+    link_affiliation(h, s);
     return true;
 }
 
-std::vector<PublicationID> Datastructures::get_publications(AffiliationID id)
+std::vector<PublicationID> Datastructures::get_publications(AffiliationID id) const
 {
-    if ( std::find(affIDList.begin(), affIDList.end(), id) == affIDList.end() ) {
-        std::vector<PublicationID> v;
-        v.push_back(NO_PUBLICATION);
-        return v;
+    DS_TIME(get_publications);
+    auto v = view_publications(id);
+    if ( !v.found() ) {
+        return {NO_PUBLICATION};
     }
+    return {v.begin(), v.end()};
+}
 
-    return affiliations_map.at(id).related_pubs;
+MappedListView<Datastructures::PubSlot, PublicationID> Datastructures::view_publications(AffiliationID id) const
+{
+    DS_TIME(view_publications);
+    AffHandle h = find_handle(id);
+    if ( h == NO_HANDLE ) { return {}; }
+    return {aff_pubs[h], pub_ids};
 }
 
-PublicationID Datastructures::get_parent(PublicationID id)
+PublicationID Datastructures::get_parent(PublicationID id) const
 {
+    DS_TIME(get_parent);
    //No publication found
-   auto i = publications_map.find(id);
-   if (i == publications_map.end()) { return NO_PUBLICATION; }
-   const auto& temp_parent = publications_map.at(id).parent;
-   return temp_parent;
+   PubSlot s = find_slot(id);
+   if (s == NO_SLOT || pub_parents[s] == NO_SLOT) { return NO_PUBLICATION; }
+   return pub_ids[pub_parents[s]];
+}
+
+std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_after(AffiliationID affiliationid, Year year) const
+{
+    DS_TIME(get_publications_after);
+    return get_publications_between(affiliationid, year, std::numeric_limits<Year>::max());
 }
 
-std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_after(AffiliationID affiliationid, Year year)
+std::vector<std::pair<Year, PublicationID> > Datastructures::get_publications_between(AffiliationID affiliationid, Year from, Year to) const
 {
+    DS_TIME(get_publications_between);
     std::vector<std::pair<Year, PublicationID>> year_and_pub;
 
     //Returning empty pair, if no IDs found.
-    if ( std::find(affIDList.begin(), affIDList.end(), affiliationid) == affIDList.end() ) {
+    AffHandle h = find_handle(affiliationid);
+    if ( h == NO_HANDLE ) {
         std::pair<Year, PublicationID> empty_pair = std::make_pair(NO_YEAR, NO_PUBLICATION);
         year_and_pub.push_back(empty_pair);
         return year_and_pub;
     }
 
-    //Sort by year, or if same year, by name
-    const auto& p_map = publications_map;
-    auto& p_vec = affiliations_map.at(affiliationid).related_pubs;
-    std::sort(p_vec.begin(), p_vec.end(),
-              [&p_map](auto const& i1, auto const& i2)
-    {
-        if ( p_map.at(i1).year == p_map.at(i2).year ) { return p_map.at(i1).name < p_map.at(i2).name; }
-        return p_map.at(i1).year < p_map.at(i2).year;
-    });
-
-    //Push back values to vector, compare to given year value
-    for ( const auto& pub : p_vec ) {
-        auto current_year = p_map.at(pub).year;
-        if ( current_year >= year) {
-            std::pair<Year, PublicationID> newpair = std::make_pair(current_year, pub);
-            year_and_pub.push_back(newpair);
-        }
+    auto [first, last] = year_range(h, from, to);
+    year_and_pub.reserve(last - first);
+    for ( auto i = first; i != last; ++i ) {
+        year_and_pub.push_back(std::make_pair(i->first, pub_ids[i->second]));
     }
     return year_and_pub;
 }
 
-std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID id)
+std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID id) const
 {
+    DS_TIME(get_referenced_by_chain);
     std::vector<PublicationID> parentChain;
 
     //Can't find ID
-    auto i = publications_map.find(id);
-    if (i == publications_map.end()) {
+    PubSlot s = find_slot(id);
+    if (s == NO_SLOT) {
         parentChain.push_back(NO_PUBLICATION);
         return parentChain;
     }
 
-    //No parents on current ID
-    if ( publications_map.at(id).parent == NO_PUBLICATION ) { return parentChain; }
-
     //Append all parents to parentChain
-    auto temp_id = get_parent(id);
-
-    while (temp_id != NO_PUBLICATION) {
-        parentChain.push_back(temp_id);
-        temp_id = get_parent(temp_id);
+    if ( ancestors_valid ) { parentChain.reserve(pub_depth[s]); }
+    for ( PubSlot p = pub_parents[s]; p != NO_SLOT; p = pub_parents[p] ) {
+        parentChain.push_back(pub_ids[p]);
     }
 
     return parentChain;
 
    // Other code snippets just in case:
    // if ( get_parent(id) != NO_PUBLICATION ) {
-   //     const auto& current_parent = publications_map.at(id).parent;
+   //     const auto& current_parent = get_parent(id);
    //     //Find parent(s) recursively
    //     auto innerParentChain = get_referenced_by_chain(current_parent);
    //     parentChain.insert(parentChain.end(), innerParentChain.begin(), innerParentChain.end());
@@ -353,121 +1329,2425 @@ std::vector<PublicationID> Datastructures::get_referenced_by_chain(PublicationID
 }
 
 std::vector<PublicationID> Datastructures::get_all_references(PublicationID id)
+{
+    DS_TIME(get_all_references);
+    intervals_update();
+    return all_references_of(id);
+}
+
+std::vector<PublicationID> Datastructures::all_references_of(PublicationID id) const
 {
     std::vector<PublicationID> all_references;
 
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id) == pubIDList.end() ) {
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) {
         all_references.push_back(NO_PUBLICATION);
         return all_references;
     }
 
-    //Fetch and push_back to all_references all the references of references.
-    const auto& r = publications_map.at(id).references;
-    for ( const auto& ref : r ) {
-        std::vector<PublicationID> ref_of_ref = get_all_references(ref);
-        all_references.insert(all_references.end(), ref_of_ref.begin(), ref_of_ref.end());
+    //The references are a contiguous part of dfs_order
+    all_references.reserve(subtree_end[s] - pre_order[s] - 1);
+    for ( auto i = pre_order[s] + 1; i < subtree_end[s]; ++i ) {
+        all_references.push_back(pub_ids[dfs_order[i]]);
     }
-
-    all_references.insert(all_references.end(), r.begin(), r.end());
     return all_references;
 }
 
-std::vector<AffiliationID> Datastructures::get_affiliations_closest_to(Coord /*xy*/)
+Datastructures::ReferenceRange Datastructures::get_all_references_range(PublicationID id) const
 {
-    // Replace the line below with your implementation
-    throw NotImplemented("get_affiliations_closest_to()");
+    DS_TIME(get_all_references_range);
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) { return {}; }
+    return {ReferenceIterator(this, s), ReferenceIterator()};
 }
 
-bool Datastructures::remove_affiliation(AffiliationID id)
+unsigned int Datastructures::get_all_references_count(PublicationID id)
 {
-    // Replace the line below with your implementation
-    // throw NotImplemented("remove_affiliation()");
+    DS_TIME(get_all_references_count);
+    intervals_update();
+    return references_count_of(id);
+}
 
-    if ( std::find(affIDList.begin(), affIDList.end(), id) == affIDList.end() ) {
-        return false;
+unsigned int Datastructures::references_count_of(PublicationID id) const
+{
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) { return 0; }
+    return subtree_end[s] - pre_order[s] - 1;
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_closest_to(Coord xy) const
+{
+    DS_TIME(get_affiliations_closest_to);
+    return get_affiliations_nearest(xy, 3);
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_nearest(Coord xy, unsigned int k) const
+{
+    DS_TIME(get_affiliations_nearest);
+    std::vector<AffHandle> candidates;
+    if ( k == 0 || grid.empty() ) { return {}; }
+
+    const long long size = grid_cell_size;
+    const long long cx = grid_cell(xy.x);
+    const long long cy = grid_cell(xy.y);
+    const long long minx = grid_cell(grid_min.x);
+    const long long maxx = grid_cell(grid_max.x);
+    const long long miny = grid_cell(grid_min.y);
+    const long long maxy = grid_cell(grid_max.y);
+
+    //Rings closer than first_ring don't reach any affiliation,
+    //rings further than last_ring can't contain any.
+    const long long first_ring = std::max({minx - cx, cx - maxx, miny - cy, cy - maxy, 0LL});
+    const long long last_ring = std::max({cx - minx, maxx - cx, cy - miny, maxy - cy});
+
+    std::vector<unsigned long long> distances;
+    auto collect = [&](std::pmr::vector<AffHandle> const& handles)
+    {
+        for ( auto h : handles ) {
+            candidates.push_back(h);
+            distances.push_back(squared_distance(xy, aff_coord(h)));
+        }
+    };
+
+    //Search ring by ring, stop once the k closest found so far are nearer
+    //than anything outside the already searched block of cells.
+    for ( long long r = first_ring; r <= last_ring; ++r ) {
+        if ( r == 0 ) {
+            grid_visit_range(cx, cy, cx, cy, collect);
+        }
+        else {
+            grid_visit_range(cx - r, cy - r, cx + r, cy - r, collect);
+            grid_visit_range(cx - r, cy + r, cx + r, cy + r, collect);
+            grid_visit_range(cx - r, cy - r + 1, cx - r, cy + r - 1, collect);
+            grid_visit_range(cx + r, cy - r + 1, cx + r, cy + r - 1, collect);
+        }
+
+        if ( candidates.size() < k ) { continue; }
+
+        long long reach = std::min({xy.x - (cx - r) * size, (cx + r + 1) * size - xy.x,
+                                    xy.y - (cy - r) * size, (cy + r + 1) * size - xy.y});
+        unsigned long long reach2 = reach >= (1LL << 32) ? std::numeric_limits<unsigned long long>::max()
+                                                         : static_cast<unsigned long long>(reach) * static_cast<unsigned long long>(reach);
+        std::vector<unsigned long long> d = distances;
+        std::nth_element(d.begin(), d.begin() + (k - 1), d.end());
+        if ( d[k - 1] < reach2 ) { break; }
     }
 
-    std::vector<PublicationID> pubs_of_id = affiliations_map.at(id).related_pubs;
+    return sort_by_distance_from(xy, candidates, k);
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_within_radius(Coord xy, int radius) const
+{
+    DS_TIME(get_affiliations_within_radius);
+    std::vector<AffHandle> found;
+    if ( radius < 0 ) { return {}; }
+
+    const auto r2 = static_cast<unsigned long long>(radius) * radius;
+    grid_visit_range(grid_cell(static_cast<long long>(xy.x) - radius), grid_cell(static_cast<long long>(xy.y) - radius),
+                     grid_cell(static_cast<long long>(xy.x) + radius), grid_cell(static_cast<long long>(xy.y) + radius),
+                     [&](std::pmr::vector<AffHandle> const& handles)
+    {
+        for ( auto h : handles ) {
+            if ( squared_distance(xy, aff_coord(h)) <= r2 ) { found.push_back(h); }
+        }
+    });
+
+    return sort_by_distance_from(xy, found, found.size());
+}
+
+std::vector<AffiliationID> Datastructures::get_affiliations_in_rectangle(Coord corner1, Coord corner2) const
+{
+    DS_TIME(get_affiliations_in_rectangle);
+    const int x1 = std::min(corner1.x, corner2.x);
+    const int x2 = std::max(corner1.x, corner2.x);
+    const int y1 = std::min(corner1.y, corner2.y);
+    const int y2 = std::max(corner1.y, corner2.y);
+
+    std::vector<AffHandle> found;
+    grid_visit_range(grid_cell(x1), grid_cell(y1), grid_cell(x2), grid_cell(y2),
+                     [&](std::pmr::vector<AffHandle> const& handles)
+    {
+        for ( auto h : handles ) {
+            Coord xy = aff_coord(h);
+            if ( xy.x >= x1 && xy.x <= x2 && xy.y >= y1 && xy.y <= y2 ) { found.push_back(h); }
+        }
+    });
+
+    //Same order as get_affiliations_distance_increasing
+    return sort_by_distance_from({0, 0}, found, found.size());
+}
+
+bool Datastructures::remove_affiliation(AffiliationID id)
+{
+    DS_TIME(remove_affiliation);
+    log_update(1, [id](Datastructures& ds) { ds.remove_affiliation(id); });
+    // Replace the line below with your implementation
+    // throw NotImplemented("remove_affiliation()");
 
-    //Delete mention of affiliation from all of it's publications
-    for ( const auto& pub : pubs_of_id ) {
-        auto& affs_of_pub = publications_map.at(pub).related_affs;
-        affs_of_pub.erase(std::remove(affs_of_pub.begin(), affs_of_pub.end(), id), affs_of_pub.end());
+    AffHandle h = find_handle(id);
+    if ( h == NO_HANDLE ) {
+        return false;
     }
 
-    //Delete from affIDList
-    affIDList.erase(std::remove(affIDList.begin(), affIDList.end(), id), affIDList.end());
+    //Delete mention of affiliation from all of it's publications, O(1) each
+    while ( !aff_pubs[h].empty() ) {
+        unlink_affiliation(aff_pubs[h].back(), aff_pub_pos[h].back());
+    }
+    unlist_affiliation(h);
 
-    //Delete from coord_to_id_map
-    auto xy = affiliations_map.at(id).coords;
+    //Delete from coord_to_id_map and the ordered indexes
+    auto xy = aff_coord(h);
+    names.affs_by_name.erase(h);
+    affs_by_distance.erase({squared_distance(xy, {0, 0}), xy.y, h});
     auto i = coord_to_id_map.find(xy);
-    coord_to_id_map.erase(i);
+    if ( i != coord_to_id_map.end() && i->second == h ) { coord_to_id_map.erase(i); }
+
+    //Delete the data and give the handle back for reuse
+    release_handle(h);
 
-    //Delete from affiliations_map
-    auto i2 = affiliations_map.find(id);
-    affiliations_map.erase(i2);
+    grid_erase(h, xy);
 
     return true;
 }
 
 PublicationID Datastructures::get_closest_common_parent(PublicationID id1, PublicationID id2)
 {
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id1) == pubIDList.end() ) {
+    DS_TIME(get_closest_common_parent);
+    ancestors_update();
+    return closest_common_parent_of(id1, id2);
+}
+
+PublicationID Datastructures::closest_common_parent_of(PublicationID id1, PublicationID id2) const
+{
+    PubSlot s1 = find_slot(id1);
+    if ( s1 == NO_SLOT ) {
         return NO_PUBLICATION;
     }
 
-    if ( std::find(pubIDList.begin(), pubIDList.end(), id2) == pubIDList.end() ) {
+    PubSlot s2 = find_slot(id2);
+    if ( s2 == NO_SLOT ) {
         return NO_PUBLICATION;
     }
 
-    std::unordered_set<PublicationID> id1_parents;
-    id1 = publications_map.at(id1).parent;
-    id2 = publications_map.at(id2).parent;
+    //Common parents of id1 and id2 are the common ancestors of their
+    //parents, the closest one is the lowest common ancestor of those.
+    PubSlot p1 = pub_parents[s1];
+    PubSlot p2 = pub_parents[s2];
+    if ( p1 == NO_SLOT || p2 == NO_SLOT ) { return NO_PUBLICATION; }
+
+    PubSlot common = lowest_common_ancestor(p1, p2);
+    if ( common == NO_SLOT ) { return NO_PUBLICATION; }
+    return pub_ids[common];
+}
+
+PublicationID Datastructures::get_kth_parent(PublicationID id, unsigned int k)
+{
+    DS_TIME(get_kth_parent);
+    ancestors_update();
+    return kth_parent_of(id, k);
+}
 
-    //List all id1's parents
-    while ( id1 != NO_PUBLICATION ) {
-        id1_parents.insert(id1);
-        id1 = publications_map.at(id1).parent;
+PublicationID Datastructures::kth_parent_of(PublicationID id, unsigned int k) const
+{
+    PubSlot s = find_slot(id);
+    if ( s == NO_SLOT ) {
+        return NO_PUBLICATION;
     }
 
-    //Compare every parent of id1 to id2's parents
-    while ( id2 != NO_PUBLICATION ) {
-        if (id1_parents.find(id2) != id1_parents.end()) { return id2; }
-        id2 = publications_map.at(id2).parent;
+    PubSlot p = kth_ancestor(s, k);
+    if ( p == NO_SLOT ) { return NO_PUBLICATION; }
+    return pub_ids[p];
+}
+
+bool Datastructures::is_ancestor(PublicationID ancestorid, PublicationID id)
+{
+    DS_TIME(is_ancestor);
+    intervals_update();
+    return is_ancestor_of(ancestorid, id);
+}
+
+bool Datastructures::is_ancestor_of(PublicationID ancestorid, PublicationID id) const
+{
+    PubSlot a = find_slot(ancestorid);
+    PubSlot s = find_slot(id);
+    if ( a == NO_SLOT || s == NO_SLOT || a == s ) {
+        return false;
     }
 
-    return NO_PUBLICATION;
+    //id is in ancestorid's subtree iff its label is inside ancestorid's interval
+    return pre_order[a] < pre_order[s] && pre_order[s] < subtree_end[a];
 }
 
 bool Datastructures::remove_publication(PublicationID publicationid)
 {
-
-    if ( std::find(pubIDList.begin(), pubIDList.end(), publicationid) == pubIDList.end() ) {
+    DS_TIME(remove_publication);
+    log_update(1, [publicationid](Datastructures& ds) { ds.remove_publication(publicationid); });
+    PubSlot s = find_slot(publicationid);
+    if ( s == NO_SLOT ) {
         return false;
     }
 
-    std::vector<AffiliationID> affs_of_id = publications_map.at(publicationid).related_affs;
-    std::vector<PublicationID> references_of_id = publications_map.at(publicationid).references;
+    //Delete mention of publication from all of it's affiliations, O(1) each
+    //apart from the year index
+    while ( !pub_affs[s].empty() ) {
+        year_index_erase(pub_affs[s].back(), s);
+        unlink_affiliation(s, pub_affs[s].size() - 1);
+    }
+
+    //Delete publicationid, if it is a parent to any Publication.
+    //Those become roots, so the ancestor tables have to be rebuilt.
+    for ( auto r : pub_refs[s] ) {
+        pub_parents[r] = NO_SLOT;
+    }
+    if ( !pub_refs[s].empty() ) {
+        ancestors_valid = false;
+        DS_COUNT(ancestors_invalidations);
+    }
+    intervals_valid = false;
+    DS_COUNT(intervals_invalidations);
+
+    //Delete from the parent's references, so no dangling ID is left behind
+    unlink_reference(s);
+    unlist_publication(s);
+
+    //Delete the columns and give the slot back for reuse
+    release_slot(s);
+
+    return true;
+}
+
+unsigned int Datastructures::add_affiliations(const std::vector<AffiliationRecord> &affiliations)
+{
+    DS_TIME(add_affiliations);
+    log_update(affiliations.size(), [affiliations](Datastructures& ds) { ds.add_affiliations(affiliations); });
+    aff_handles.reserve(aff_handles.size() + affiliations.size());
+    coord_to_id_map.reserve(coord_to_id_map.size() + affiliations.size());
+    if ( affIDList_valid ) { affIDList.reserve(affIDList.size() + affiliations.size()); }
+    return add_affiliation_range(affiliations.data(), affiliations.data() + affiliations.size());
+}
+
+unsigned int Datastructures::add_affiliation_range(AffiliationRecord const* first, AffiliationRecord const* last)
+{
+    //One pass: IDs already in the store or earlier in the batch are skipped
+    std::vector<AffHandle> added;
+    added.reserve(last - first);
+    for ( ; first != last; ++first ) {
+        const auto& a = *first;
+        if ( aff_handles.find(a.id) != aff_handles.end() ) { continue; }
+
+        AffHandle h = new_handle(a.id);
+        aff_x[h] = a.xy.x;
+        aff_y[h] = a.xy.y;
+        names.affs[h] = store_name(a.name);
+        added.push_back(h);
+        list_affiliation(h);
+        coord_to_id_map[a.xy] = h;
+        names.affs_by_name.insert(h);
+        affs_by_distance.insert({squared_distance(a.xy, {0, 0}), a.xy.y, h});
+    }
+
+    //Grid is rebuilt once if the batch grew the store enough, otherwise filled cell by cell
+    if ( aff_handles.size() > 2 * grid_built_for + 8 ) {
+        grid_rebuild();
+    }
+    else {
+        for ( auto h : added ) { grid_insert(h, aff_coord(h)); }
+    }
+
+    return added.size();
+}
+
+unsigned int Datastructures::add_publications(const std::vector<PublicationRecord> &publications)
+{
+    DS_TIME(add_publications);
+    log_update(publications.size(), [publications](Datastructures& ds) { ds.add_publications(publications); });
+    publications_map.reserve(publications_map.size() + publications.size());
+    if ( pubIDList_valid ) { pubIDList.reserve(pubIDList.size() + publications.size()); }
+    return add_publication_range(publications.data(), publications.data() + publications.size(), nullptr);
+}
+
+unsigned int Datastructures::add_publication_range(PublicationRecord const* first, PublicationRecord const* last,
+                                                   std::vector<PublicationRecord>* deferred)
+{
+    unsigned int added = 0;
+    std::vector<AffHandle> handles;
+    for ( ; first != last; ++first ) {
+        const auto& p = *first;
+        if ( publications_map.find(p.id) != publications_map.end() ) { continue; }
+
+        //Every affiliation has to exist, same as add_publication
+        handles.clear();
+        for ( const auto& a : p.affiliations ) {
+            AffHandle h = find_handle(a);
+            if ( h == NO_HANDLE ) { break; }
+            handles.push_back(h);
+        }
+        if ( handles.size() != p.affiliations.size() ) {
+            if ( deferred ) { deferred->push_back(p); }
+            continue;
+        }
+
+        PubSlot s = new_slot(p.id);
+        pub_years[s] = p.year;
+        year_tree_add(p.year, 1);
+        names.pubs[s] = store_name(p.name);
+        index_publication_name(s);
+        list_publication(s);
+        for ( auto h : handles ) { link_affiliation(h, s); }
+        ++added;
+    }
+
+    return added;
+}
+
+unsigned int Datastructures::add_references(const std::vector<ReferenceRecord> &references)
+{
+    DS_TIME(add_references);
+    log_update(references.size(), [references](Datastructures& ds) { ds.add_references(references); });
+    return add_reference_range(references.data(), references.data() + references.size(), nullptr);
+}
+
+unsigned int Datastructures::add_reference_range(ReferenceRecord const* first, ReferenceRecord const* last,
+                                                 std::vector<ReferenceRecord>* deferred)
+{
+    unsigned int added = 0;
+    for ( ; first != last; ++first ) {
+        const auto& r = *first;
+        PubSlot child = find_slot(r.first);
+        PubSlot parent = find_slot(r.second);
+        if ( child == NO_SLOT || parent == NO_SLOT ) {
+            if ( deferred ) { deferred->push_back(r); }
+            continue;
+        }
+
+        if ( link_reference(child, parent) ) { ++added; }
+    }
+
+    return added;
+}
+
+
+
+void Datastructures::grid_insert(AffHandle h, Coord xy)
+{
+    //Cell size is picked for the current count, re-pick when it has doubled.
+    //Rebuild reads the interned affiliations, so h is included.
+    if ( aff_handles.size() > 2 * grid_built_for + 8 ) {
+        grid_rebuild();
+        return;
+    }
+
+    if ( grid.empty() && grid_min == NO_COORD ) {
+        grid_min = xy;
+        grid_max = xy;
+    }
+    grid_min = {std::min(grid_min.x, xy.x), std::min(grid_min.y, xy.y)};
+    grid_max = {std::max(grid_max.x, xy.x), std::max(grid_max.y, xy.y)};
+    grid[grid_key(grid_cell(xy.x), grid_cell(xy.y))].push_back(h);
+}
+
+void Datastructures::grid_erase(AffHandle h, Coord xy)
+{
+    auto i = grid.find(grid_key(grid_cell(xy.x), grid_cell(xy.y)));
+    if ( i == grid.end() ) { return; }
+
+    auto& handles = i->second;
+    auto pos = std::find(handles.begin(), handles.end(), h);
+    if ( pos != handles.end() ) {
+        *pos = handles.back();
+        handles.pop_back();
+    }
+    if ( handles.empty() ) { grid.erase(i); }
+
+    //Too large cells after mass removal, re-pick the size
+    if ( aff_handles.size() * 4 < grid_built_for ) { grid_rebuild(); }
+}
+
+void Datastructures::grid_rebuild()
+{
+    DS_COUNT(grid_rebuilds);
+    grid.clear();
+    grid_built_for = aff_handles.size();
+    grid_min = NO_COORD;
+    grid_max = NO_COORD;
+    grid_cell_size = 1;
+    if ( aff_handles.empty() ) { return; }
+
+    grid_min = aff_coord(aff_handles.begin()->second);
+    grid_max = grid_min;
+    for ( const auto& a : aff_handles ) {
+        Coord xy = aff_coord(a.second);
+        grid_min = {std::min(grid_min.x, xy.x), std::min(grid_min.y, xy.y)};
+        grid_max = {std::max(grid_max.x, xy.x), std::max(grid_max.y, xy.y)};
+    }
+
+    //Aim for about two affiliations per cell on evenly spread data
+    double width = static_cast<double>(grid_max.x) - grid_min.x + 1;
+    double height = static_cast<double>(grid_max.y) - grid_min.y + 1;
+    double side = std::ceil(std::sqrt(2.0 * width * height / grid_built_for));
+    grid_cell_size = static_cast<int>(std::min(std::max(side, 1.0), 1073741824.0));
+
+    grid.reserve(grid_built_for);
+    for ( const auto& a : aff_handles ) {
+        Coord xy = aff_coord(a.second);
+        grid[grid_key(grid_cell(xy.x), grid_cell(xy.y))].push_back(a.second);
+    }
+}
+
+long long Datastructures::grid_cell(long long v) const
+{
+    //Floor division, so that negative coordinates get their own cells
+    long long q = v / grid_cell_size;
+    if ( v % grid_cell_size < 0 ) { --q; }
+    return q;
+}
+
+template <typename Visit>
+void Datastructures::grid_visit_range(long long cx1, long long cy1, long long cx2, long long cy2, Visit visit) const
+{
+    if ( grid.empty() ) { return; }
+
+    cx1 = std::max(cx1, grid_cell(grid_min.x));
+    cy1 = std::max(cy1, grid_cell(grid_min.y));
+    cx2 = std::min(cx2, grid_cell(grid_max.x));
+    cy2 = std::min(cy2, grid_cell(grid_max.y));
+    if ( cx1 > cx2 || cy1 > cy2 ) { return; }
+
+    //Walking the range cell by cell only pays off while it has fewer cells than the grid
+    unsigned long long width = cx2 - cx1 + 1;
+    unsigned long long height = cy2 - cy1 + 1;
+    if ( width > grid.size() / height ) {
+        for ( const auto& cell : grid ) {
+            long long cx = static_cast<int>(static_cast<unsigned int>(cell.first >> 32));
+            long long cy = static_cast<int>(static_cast<unsigned int>(cell.first));
+            if ( cx >= cx1 && cx <= cx2 && cy >= cy1 && cy <= cy2 ) { visit(cell.second); }
+        }
+        return;
+    }
+
+    for ( long long cy = cy1; cy <= cy2; ++cy ) {
+        for ( long long cx = cx1; cx <= cx2; ++cx ) {
+            auto i = grid.find(grid_key(cx, cy));
+            if ( i != grid.end() ) { visit(i->second); }
+        }
+    }
+}
+
+std::vector<AffiliationID> Datastructures::sort_by_distance_from(Coord xy, std::vector<AffHandle> const& handles, std::size_t count) const
+{
+    //Gather the coordinates so that the distances are one pass of the kernel
+    std::vector<int> xs(handles.size());
+    std::vector<int> ys(handles.size());
+    for ( std::size_t i = 0; i < handles.size(); ++i ) {
+        xs[i] = aff_x[handles[i]];
+        ys[i] = aff_y[handles[i]];
+    }
+    std::vector<unsigned long long> dist(handles.size());
+    squared_distances(xy, xs.data(), ys.data(), handles.size(), dist.data());
+    return sort_by_distance(handles, dist, count);
+}
+
+std::vector<AffiliationID> Datastructures::sort_by_distance(std::vector<AffHandle> const& handles,
+                                                            std::vector<unsigned long long> const& dist, std::size_t count) const
+{
+    struct Keyed
+    {
+        unsigned long long dist;
+        int y;
+        AffHandle h;
+
+        bool operator<(Keyed const& other) const
+        {
+            return std::tie(dist, y, h) < std::tie(other.dist, other.y, other.h);
+        }
+    };
+
+    std::vector<Keyed> keyed;
+    keyed.reserve(handles.size());
+    for ( std::size_t i = 0; i < handles.size(); ++i ) {
+        keyed.push_back({dist[i], aff_y[handles[i]], handles[i]});
+    }
+
+    //Top-k: select the count smallest in O(n), then sort only those
+    count = std::min(count, keyed.size());
+    if ( count < keyed.size() ) {
+        std::nth_element(keyed.begin(), keyed.begin() + count, keyed.end());
+    }
+    parallel_sort(keyed.begin(), keyed.begin() + count);
+
+    std::vector<AffiliationID> sorted;
+    sorted.reserve(count);
+    for ( std::size_t i = 0; i < count; ++i ) { sorted.push_back(aff_ids[keyed[i].h]); }
+    return sorted;
+}
+
+Datastructures::AffHandle Datastructures::find_handle(const AffiliationID &id) const
+{
+    auto i = aff_handles.find(id);
+    if ( i == aff_handles.end() ) { return NO_HANDLE; }
+    return i->second;
+}
+
+Datastructures::AffHandle Datastructures::new_handle(const AffiliationID &id)
+{
+    AffHandle h;
+    if ( !free_handles.empty() ) {
+        h = free_handles.back();
+        free_handles.pop_back();
+        aff_ids[h] = id;
+    }
+    else {
+        h = aff_ids.size();
+        aff_ids.push_back(id);
+        aff_x.push_back(0);
+        aff_y.push_back(0);
+        names.affs.push_back({});
+        aff_pubs.emplace_back();
+        aff_pub_pos.emplace_back();
+        aff_years.emplace_back();
+        aff_links.emplace_back();
+        aff_list_pos.push_back(0);
+    }
+    aff_handles.insert({id, h});
+    if ( id.size() > SHORT_ID_LENGTH ) { long_ids.seen = true; }
+    return h;
+}
+
+void Datastructures::release_handle(AffHandle h)
+{
+    aff_handles.erase(aff_ids[h]);
+    aff_ids[h] = NO_AFFILIATION;
+    names.affs[h] = {};
+    aff_pubs.release(h);
+    aff_pub_pos.release(h);
+    aff_years.release(h);
+    aff_links.release(h);
+    free_handles.push_back(h);
+}
+
+Datastructures::PubSlot Datastructures::find_slot(PublicationID id) const
+{
+    auto i = publications_map.find(id);
+    if ( i == publications_map.end() ) { return NO_SLOT; }
+    return i->second;
+}
+
+Datastructures::PubSlot Datastructures::new_slot(PublicationID id)
+{
+    PubSlot s;
+    if ( !free_slots.empty() ) {
+        s = free_slots.back();
+        free_slots.pop_back();
+        pub_ids[s] = id;
+    }
+    else {
+        s = pub_ids.size();
+        pub_ids.push_back(id);
+        pub_years.push_back(NO_YEAR);
+        pub_parents.push_back(NO_SLOT);
+        names.pubs.push_back({});
+        pub_affs.emplace_back();
+        pub_aff_pos.emplace_back();
+        pub_refs.emplace_back();
+        pub_ref_pos.push_back(0);
+        pub_list_pos.push_back(0);
+    }
+    pub_parents[s] = NO_SLOT;
+    publications_map.insert({id, s});
+
+    //New publication is a root, the tables stay valid
+    if ( ancestors_valid ) {
+        if ( s == pub_depth.size() ) {
+            pub_depth.push_back(0);
+            for ( auto& level : lift ) { level.push_back(NO_SLOT); }
+        }
+        else {
+            pub_depth[s] = 0;
+            for ( auto& level : lift ) { level[s] = NO_SLOT; }
+        }
+    }
 
-    //Delete mention of publication from all of it's affiliations
-    for ( const auto& aff : affs_of_id ) {
-        auto& pubs_of_aff = affiliations_map.at(aff).related_pubs;
-        pubs_of_aff.erase(std::remove(pubs_of_aff.begin(), pubs_of_aff.end(), publicationid), pubs_of_aff.end());
+    //A new root gets the next interval at the end of dfs_order
+    if ( intervals_valid ) {
+        if ( s >= pre_order.size() ) {
+            pre_order.resize(s + 1);
+            subtree_end.resize(s + 1);
+        }
+        pre_order[s] = dfs_order.size();
+        dfs_order.push_back(s);
+        subtree_end[s] = dfs_order.size();
     }
+    return s;
+}
+
+void Datastructures::release_slot(PubSlot s)
+{
+    unindex_publication_name(s);
+    publications_map.erase(pub_ids[s]);
+    pub_ids[s] = NO_PUBLICATION;
+    year_tree_add(pub_years[s], -1);
+    pub_years[s] = NO_YEAR;
+    pub_parents[s] = NO_SLOT;
+    names.pubs[s] = {};
+    pub_affs.release(s);
+    pub_aff_pos.release(s);
+    pub_refs.release(s);
+    free_slots.push_back(s);
+    if ( pub_trigram_garbage > pub_trigram_entries / 2 ) { pub_trigrams_rebuild(); }
+}
+
+Datastructures::NameRef Datastructures::store_name(const Name &name)
+{
+    NameRef ref{names.pool.size(), static_cast<unsigned int>(name.size())};
+    names.pool += name;
+    return ref;
+}
+
+std::string_view Datastructures::name_of(NameRef ref) const
+{
+    return names.of(ref);
+}
+
+bool Datastructures::year_order(const std::pair<Year, PubSlot> &e1, const std::pair<Year, PubSlot> &e2) const
+{
+    if ( e1.first != e2.first ) { return e1.first < e2.first; }
+    auto name1 = name_of(names.pubs[e1.second]);
+    auto name2 = name_of(names.pubs[e2.second]);
+    if ( name1 != name2 ) { return name1 < name2; }
+    return pub_ids[e1.second] < pub_ids[e2.second];
+}
+
+void Datastructures::year_index_insert(AffHandle h, PubSlot s)
+{
+    auto index = aff_years[h];
+    std::pair<Year, PubSlot> entry{pub_years[s], s};
+    auto pos = std::upper_bound(index.begin(), index.end(), entry,
+                                [this](auto const& e1, auto const& e2) { return year_order(e1, e2); });
+    index.insert(pos, entry);
+}
 
-    //Delete publicationid, if it is a parent to any Publication
-    for ( auto& r : references_of_id) {
-        publications_map.at(r).parent = NO_PUBLICATION;
+void Datastructures::year_index_erase(AffHandle h, PubSlot s)
+{
+    //Equal entries are next to each other, erase all of them in case the
+    //publication was added to the affiliation more than once
+    auto index = aff_years[h];
+    std::pair<Year, PubSlot> entry{pub_years[s], s};
+    auto first = std::lower_bound(index.begin(), index.end(), entry,
+                                  [this](auto const& e1, auto const& e2) { return year_order(e1, e2); });
+    auto last = first;
+    while ( last != index.end() && last->second == s ) { ++last; }
+    index.erase(first, last);
+}
+
+bool Datastructures::link_reference(PubSlot child, PubSlot parent)
+{
+    //A reference can't make a publication its own parent. Walking the chain
+    //is cheaper than a rebuild while the tables are out of date.
+    if ( child == parent ) { return false; }
+    if ( ancestors_valid ) {
+        if ( is_ancestor_slot(child, parent) ) { return false; }
+    }
+    else {
+        for ( PubSlot p = pub_parents[parent]; p != NO_SLOT; p = pub_parents[p] ) {
+            if ( p == child ) { return false; }
+        }
     }
 
-    //Delete from pubIDList
-    pubIDList.erase(std::remove(pubIDList.begin(), pubIDList.end(), publicationid), pubIDList.end());
+    //A publication has only one parent, move it from the old one
+    unlink_reference(child);
 
-    //Delete from publications_map
-    auto i2 = publications_map.find(publicationid);
-    publications_map.erase(i2);
+    pub_ref_pos[child] = pub_refs[parent].size();
+    pub_refs[parent].push_back(child);
+    pub_parents[child] = parent;
+    intervals_valid = false;
+    DS_COUNT(intervals_invalidations);
 
+    //Only child's own row changes if it has no references of its own,
+    //otherwise the whole subtree moved and the tables are rebuilt lazily.
+    if ( ancestors_valid && pub_refs[child].empty() ) {
+        ancestors_extend(child);
+    }
+    else {
+        ancestors_valid = false;
+        DS_COUNT(ancestors_invalidations);
+    }
     return true;
 }
 
+void Datastructures::ancestors_update()
+{
+    if ( ancestors_valid ) {
+        DS_COUNT(ancestors_hits);
+        return;
+    }
+    DS_COUNT(ancestors_rebuilds);
+
+    const std::size_t n = pub_ids.size();
+    pub_depth.assign(n, 0);
+
+    //Roots first, then every publication after its parent
+    std::vector<PubSlot> order;
+    order.reserve(n);
+    for ( PubSlot s = 0; s < n; ++s ) {
+        if ( pub_ids[s] != NO_PUBLICATION && pub_parents[s] == NO_SLOT ) { order.push_back(s); }
+    }
+    unsigned int max_depth = 0;
+    for ( std::size_t i = 0; i < order.size(); ++i ) {
+        for ( auto r : pub_refs[order[i]] ) {
+            pub_depth[r] = pub_depth[order[i]] + 1;
+            max_depth = std::max(max_depth, pub_depth[r]);
+            order.push_back(r);
+        }
+    }
+
+    //Enough levels that 2^levels > max_depth
+    std::size_t levels = 1;
+    while ( (1ULL << levels) <= max_depth ) { ++levels; }
+
+    lift.assign(levels, std::vector<PubSlot>(n, NO_SLOT));
+    lift[0] = pub_parents;
+    for ( std::size_t j = 1; j < levels; ++j ) {
+        for ( PubSlot s = 0; s < n; ++s ) {
+            PubSlot mid = lift[j - 1][s];
+            lift[j][s] = mid == NO_SLOT ? NO_SLOT : lift[j - 1][mid];
+        }
+    }
+
+    ancestors_valid = true;
+}
+
+void Datastructures::ancestors_extend(PubSlot s)
+{
+    PubSlot parent = pub_parents[s];
+    pub_depth[s] = pub_depth[parent] + 1;
+
+    //Chain got deeper than the tables reach, add a level for everyone
+    if ( (1ULL << lift.size()) <= pub_depth[s] ) {
+        const auto& top = lift.back();
+        std::vector<PubSlot> level(top.size(), NO_SLOT);
+        for ( PubSlot i = 0; i < top.size(); ++i ) {
+            if ( top[i] != NO_SLOT ) { level[i] = top[top[i]]; }
+        }
+        lift.push_back(std::move(level));
+    }
+
+    lift[0][s] = parent;
+    for ( std::size_t j = 1; j < lift.size(); ++j ) {
+        PubSlot mid = lift[j - 1][s];
+        lift[j][s] = mid == NO_SLOT ? NO_SLOT : lift[j - 1][mid];
+    }
+}
+
+Datastructures::PubSlot Datastructures::kth_ancestor(PubSlot s, unsigned int k) const
+{
+    if ( k > pub_depth[s] ) { return NO_SLOT; }
+    for ( std::size_t j = 0; k != 0; ++j, k >>= 1 ) {
+        if ( k & 1 ) { s = lift[j][s]; }
+    }
+    return s;
+}
+
+Datastructures::PubSlot Datastructures::lowest_common_ancestor(PubSlot a, PubSlot b) const
+{
+    //Lift the deeper one to the same depth, then both just below the meeting point
+    if ( pub_depth[a] < pub_depth[b] ) { std::swap(a, b); }
+    a = kth_ancestor(a, pub_depth[a] - pub_depth[b]);
+    if ( a == b ) { return a; }
+
+    for ( std::size_t j = lift.size(); j-- > 0; ) {
+        if ( lift[j][a] != lift[j][b] ) {
+            a = lift[j][a];
+            b = lift[j][b];
+        }
+    }
+    return lift[0][a];
+}
+
+bool Datastructures::is_ancestor_slot(PubSlot ancestor, PubSlot s) const
+{
+    return pub_depth[ancestor] < pub_depth[s]
+            && kth_ancestor(s, pub_depth[s] - pub_depth[ancestor]) == ancestor;
+}
 
+void Datastructures::intervals_update()
+{
+    if ( intervals_valid ) {
+        DS_COUNT(intervals_hits);
+        return;
+    }
+    DS_COUNT(intervals_rebuilds);
+
+    const std::size_t n = pub_ids.size();
+    dfs_order.clear();
+    dfs_order.reserve(n);
+    pre_order.assign(n, 0);
+    subtree_end.assign(n, 0);
+
+    //Iterative preorder from every root
+    std::vector<PubSlot> stack;
+    for ( PubSlot root = 0; root < n; ++root ) {
+        if ( pub_ids[root] == NO_PUBLICATION || pub_parents[root] != NO_SLOT ) { continue; }
+
+        stack.push_back(root);
+        while ( !stack.empty() ) {
+            PubSlot s = stack.back();
+            stack.pop_back();
+            pre_order[s] = dfs_order.size();
+            dfs_order.push_back(s);
+            const auto& refs = pub_refs[s];
+            stack.insert(stack.end(), refs.rbegin(), refs.rend());
+        }
+    }
+
+    //Subtree sizes bottom-up: children come after their parent in dfs_order
+    std::vector<unsigned int> size(n, 1);
+    for ( auto i = dfs_order.size(); i-- > 0; ) {
+        PubSlot s = dfs_order[i];
+        subtree_end[s] = pre_order[s] + size[s];
+        if ( pub_parents[s] != NO_SLOT ) { size[pub_parents[s]] += size[s]; }
+    }
+
+    intervals_valid = true;
+}
+
+Datastructures::ReferenceIterator::ReferenceIterator(const Datastructures *ds, PubSlot root)
+    : ds_{ds}
+{
+    const auto& refs = ds_->pub_refs[root];
+    stack_.assign(refs.rbegin(), refs.rend());
+}
+
+Datastructures::ReferenceIterator &Datastructures::ReferenceIterator::operator++()
+{
+    PubSlot s = stack_.back();
+    stack_.pop_back();
+    const auto& refs = ds_->pub_refs[s];
+    stack_.insert(stack_.end(), refs.rbegin(), refs.rend());
+    return *this;
+}
+
+Datastructures::ReferenceIterator Datastructures::ReferenceIterator::operator++(int)
+{
+    auto old = *this;
+    ++*this;
+    return old;
+}
+
+std::vector<AffiliationID> Snapshot::get_all_affiliations() const
+{
+    DS_TIME_OF(data_, get_all_affiliations);
+    return {data_.affIDList.begin(), data_.affIDList.end()};
+}
+
+std::vector<PublicationID> Snapshot::all_publications() const
+{
+    DS_TIME_OF(data_, all_publications);
+    return data_.pubIDList;
+}
+
+PublicationID Snapshot::get_closest_common_parent(PublicationID id1, PublicationID id2) const
+{
+    DS_TIME_OF(data_, get_closest_common_parent);
+    return data_.closest_common_parent_of(id1, id2);
+}
+
+PublicationID Snapshot::get_kth_parent(PublicationID id, unsigned int k) const
+{
+    DS_TIME_OF(data_, get_kth_parent);
+    return data_.kth_parent_of(id, k);
+}
+
+bool Snapshot::is_ancestor(PublicationID ancestorid, PublicationID id) const
+{
+    DS_TIME_OF(data_, is_ancestor);
+    return data_.is_ancestor_of(ancestorid, id);
+}
+
+std::vector<PublicationID> Snapshot::get_all_references(PublicationID id) const
+{
+    DS_TIME_OF(data_, get_all_references);
+    return data_.all_references_of(id);
+}
+
+unsigned int Snapshot::get_all_references_count(PublicationID id) const
+{
+    DS_TIME_OF(data_, get_all_references_count);
+    return data_.references_count_of(id);
+}
+
+bool Datastructures::save_snapshot(const std::string &path) const
+{
+    DS_TIME(save_snapshot);
+    SnapshotWriter out(path);
+    if ( !out.ok() ) { return false; }
+
+    out.write_raw(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    out.write_raw(&SNAPSHOT_VERSION, sizeof(SNAPSHOT_VERSION));
+    out.write_raw(&SNAPSHOT_BYTE_ORDER, sizeof(SNAPSHOT_BYTE_ORDER));
+
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    auto write_names = [&](std::vector<NameRef> const& refs)
+    {
+        offsets.clear();
+        lengths.clear();
+        for ( auto const& r : refs ) {
+            offsets.push_back(r.offset);
+            lengths.push_back(r.length);
+        }
+        out.write_array(offsets);
+        out.write_array(lengths);
+    };
+
+    out.write_array(names.pool.data(), names.pool.size());
+
+    //Affiliation columns, AffiliationIDs back to back like the names
+    std::string id_pool;
+    offsets.assign(1, 0);
+    for ( auto const& id : aff_ids ) {
+        id_pool += id;
+        offsets.push_back(id_pool.size());
+    }
+    out.write_array(id_pool.data(), id_pool.size());
+    out.write_array(offsets);
+    out.write_array(aff_x);
+    out.write_array(aff_y);
+    write_names(names.affs);
+    out.write_csr(aff_pubs);
+    out.write_csr(aff_pub_pos);
+    out.write_csr(aff_years);
+    out.write_csr(aff_links);
+    out.write_array(free_handles);
+
+    //Publication columns
+    out.write_array(pub_ids);
+    out.write_array(pub_years);
+    out.write_array(pub_parents);
+    write_names(names.pubs);
+    out.write_csr(pub_affs);
+    out.write_csr(pub_aff_pos);
+    out.write_csr(pub_refs);
+    out.write_array(free_slots);
+
+    //Index contents in their own order, so that loading can append to them
+    std::vector<unsigned int> order;
+    for ( auto h : names.affs_by_name ) { order.push_back(h); }
+    out.write_array(order);
+    order.clear();
+    for ( auto const& a : affs_by_distance ) { order.push_back(std::get<2>(a)); }
+    out.write_array(order);
+    order.clear();
+    for ( auto const& c : coord_to_id_map ) { order.push_back(c.second); }
+    out.write_array(order);
+    order.clear();
+    for ( auto s : names.pubs_by_name ) { order.push_back(s); }
+    out.write_array(order);
+
+    //Year counts, the grid and the trigram index as they are
+    out.write_array(year_tree);
+    std::vector<long long> grid_shape{grid_cell_size, static_cast<long long>(grid_built_for),
+                                      grid_min.x, grid_min.y, grid_max.x, grid_max.y};
+    out.write_array(grid_shape);
+    out.write_buckets(grid);
+    std::vector<std::uint64_t> trigram_counts{pub_trigram_entries, pub_trigram_garbage};
+    out.write_array(trigram_counts);
+    out.write_buckets(pub_trigrams);
+
+    return out.finish();
+}
+
+bool Datastructures::load_snapshot(const std::string &path)
+{
+    DS_TIME(load_snapshot);
+    MappedFile file(path);
+    if ( !file.data() ) { return false; }
+
+    //Build into a separate object so that a broken file leaves this one as it was
+    Datastructures loaded;
+    if ( !loaded.read_snapshot(file.data(), file.size()) ) { return false; }
+
+    *this = std::move(loaded);
+    log_lost();
+    return true;
+}
+
+bool Datastructures::read_snapshot(const char *data, std::size_t size)
+{
+    SnapshotReader in(data, size);
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    std::uint32_t version = 0;
+    std::uint32_t byte_order = 0;
+    if ( !in.read_raw(magic, sizeof(magic)) || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 ) { return false; }
+    if ( !in.read_raw(&version, sizeof(version)) || version != SNAPSHOT_VERSION ) { return false; }
+    if ( !in.read_raw(&byte_order, sizeof(byte_order)) || byte_order != SNAPSHOT_BYTE_ORDER ) { return false; }
+
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    auto read_names = [&](std::vector<NameRef>& refs, std::size_t count)
+    {
+        if ( !in.read_array(offsets, count) || !in.read_array(lengths, count) ) { return false; }
+        refs.resize(count);
+        for ( std::size_t i = 0; i < count; ++i ) {
+            if ( offsets[i] > names.pool.size() || lengths[i] > names.pool.size() - offsets[i] ) { return false; }
+            refs[i] = {offsets[i], lengths[i]};
+        }
+        return true;
+    };
+    auto any = [](auto const&) { return true; };
+
+    char const* bytes = nullptr;
+    std::size_t byte_count = 0;
+    if ( !in.read_view(bytes, byte_count) ) { return false; }
+    names.pool.assign(bytes, byte_count);
+
+    //Affiliations. The lists are checked against the publications below.
+    if ( !in.read_view(bytes, byte_count) || !in.read_array(offsets) || offsets.empty() ) { return false; }
+    const std::size_t aff_count = offsets.size() - 1;
+    aff_ids.resize(aff_count);
+    for ( std::size_t h = 0; h < aff_count; ++h ) {
+        if ( offsets[h] > offsets[h + 1] || offsets[h + 1] > byte_count ) { return false; }
+        aff_ids[h].assign(bytes + offsets[h], offsets[h + 1] - offsets[h]);
+    }
+    if ( !in.read_array(aff_x, aff_count) || !in.read_array(aff_y, aff_count) ) { return false; }
+    if ( !read_names(names.affs, aff_count) ) { return false; }
+    if ( !in.read_csr(aff_pubs, aff_count, any) || !in.read_csr(aff_pub_pos, aff_count, any) ) { return false; }
+    if ( !in.read_csr(aff_years, aff_count, any) ) { return false; }
+    if ( !in.read_csr(aff_links, aff_count, [&](std::pair<AffHandle, Weight> const& link)
+                      { return link.first < aff_count && link.second > 0; }) ) { return false; }
+    if ( !in.read_array(free_handles) ) { return false; }
+
+    //Publications
+    if ( !in.read_array(pub_ids) ) { return false; }
+    const std::size_t pub_count = pub_ids.size();
+    auto is_handle = [&](AffHandle h) { return h < aff_count; };
+    auto is_slot = [&](PubSlot s) { return s < pub_count; };
+    if ( !in.read_array(pub_years, pub_count) || !in.read_array(pub_parents, pub_count) ) { return false; }
+    if ( !read_names(names.pubs, pub_count) ) { return false; }
+    if ( !in.read_csr(pub_affs, pub_count, is_handle) || !in.read_csr(pub_aff_pos, pub_count, any) ) { return false; }
+    if ( !in.read_csr(pub_refs, pub_count, is_slot) ) { return false; }
+    if ( !in.read_array(free_slots) ) { return false; }
+
+    //Both directions of the affiliation/publication links have to agree:
+    //every entry of aff_pubs points to the one entry of pub_affs that points back
+    std::size_t links = 0;
+    for ( AffHandle h = 0; h < aff_count; ++h ) {
+        auto pubs = aff_pubs[h];
+        if ( aff_pub_pos[h].size() != pubs.size() || aff_years[h].size() != pubs.size() ) { return false; }
+        for ( unsigned int k = 0; k < pubs.size(); ++k ) {
+            PubSlot s = pubs[k];
+            unsigned int j = aff_pub_pos[h][k];
+            if ( s >= pub_count || j >= pub_affs[s].size() || pub_aff_pos[s].size() != pub_affs[s].size() ) { return false; }
+            if ( pub_affs[s][j] != h || pub_aff_pos[s][j] != k ) { return false; }
+            auto year = aff_years[h][k];
+            if ( year.second >= pub_count || year.first != pub_years[year.second] ) { return false; }
+        }
+        links += pubs.size();
+    }
+    std::size_t back_links = 0;
+    for ( PubSlot s = 0; s < pub_count; ++s ) { back_links += pub_affs[s].size(); }
+    if ( links != back_links ) { return false; }
+
+    pub_ref_pos.assign(pub_count, 0);
+    for ( PubSlot s = 0; s < pub_count; ++s ) {
+        for ( unsigned int i = 0; i < pub_refs[s].size(); ++i ) { pub_ref_pos[pub_refs[s][i]] = i; }
+    }
+    aff_list_pos.assign(aff_count, 0);
+    pub_list_pos.assign(pub_count, 0);
+    for ( auto h : free_handles ) {
+        if ( h >= aff_count || aff_ids[h] != NO_AFFILIATION ) { return false; }
+    }
+    for ( auto s : free_slots ) {
+        if ( s >= pub_count || pub_ids[s] != NO_PUBLICATION ) { return false; }
+    }
+
+    //Hash maps are rebuilt, one insert per record or link
+    aff_handles.reserve(aff_count);
+    for ( AffHandle h = 0; h < aff_count; ++h ) {
+        if ( aff_ids[h] != NO_AFFILIATION && !aff_handles.insert({aff_ids[h], h}).second ) { return false; }
+        if ( aff_ids[h].size() > SHORT_ID_LENGTH ) { long_ids.seen = true; }
+    }
+    publications_map.reserve(pub_count);
+    for ( PubSlot s = 0; s < pub_count; ++s ) {
+        if ( pub_ids[s] == NO_PUBLICATION ) { continue; }
+        if ( !publications_map.insert({pub_ids[s], s}).second ) { return false; }
+        if ( pub_parents[s] != NO_SLOT && pub_parents[s] >= pub_count ) { return false; }
+    }
+    std::size_t link_count = 0;
+    for ( AffHandle h = 0; h < aff_count; ++h ) { link_count += aff_links[h].size(); }
+    link_pos.reserve(link_count);
+    for ( AffHandle h = 0; h < aff_count; ++h ) {
+        for ( unsigned int i = 0; i < aff_links[h].size(); ++i ) {
+            if ( !link_pos.insert({link_key(h, aff_links[h][i].first), i}).second ) { return false; }
+        }
+    }
+
+    //The reference forest has to agree with the parents and be acyclic:
+    //walking down from the roots must reach every publication exactly once.
+    std::size_t reached = 0;
+    std::vector<PubSlot> stack;
+    for ( PubSlot s = 0; s < pub_count; ++s ) {
+        if ( pub_ids[s] != NO_PUBLICATION && pub_parents[s] == NO_SLOT ) { stack.push_back(s); }
+    }
+    while ( !stack.empty() ) {
+        PubSlot s = stack.back();
+        stack.pop_back();
+        ++reached;
+        for ( auto r : pub_refs[s] ) {
+            if ( pub_parents[r] != s || pub_ids[r] == NO_PUBLICATION ) { return false; }
+            stack.push_back(r);
+        }
+    }
+    if ( reached != publications_map.size() ) { return false; }
+
+    //Ordered indexes were saved in order, every insert goes to the end
+    std::vector<unsigned int> order;
+    if ( !in.read_array(order, aff_handles.size()) ) { return false; }
+    for ( auto h : order ) {
+        if ( h >= aff_count ) { return false; }
+        names.affs_by_name.emplace_hint(names.affs_by_name.end(), h);
+    }
+    if ( !in.read_array(order, aff_handles.size()) ) { return false; }
+    for ( auto h : order ) {
+        if ( h >= aff_count ) { return false; }
+        affs_by_distance.emplace_hint(affs_by_distance.end(), squared_distance(aff_coord(h), {0, 0}), aff_y[h], h);
+    }
+    if ( !in.read_array(order) ) { return false; }
+    coord_to_id_map.reserve(order.size());
+    for ( auto h : order ) {
+        if ( h >= aff_count ) { return false; }
+        coord_to_id_map[aff_coord(h)] = h;
+    }
+    if ( !in.read_array(order, publications_map.size()) ) { return false; }
+    for ( auto s : order ) {
+        if ( s >= pub_count || pub_ids[s] == NO_PUBLICATION ) { return false; }
+        names.pubs_by_name.emplace_hint(names.pubs_by_name.end(), s);
+    }
+    if ( names.affs_by_name.size() != aff_handles.size() || affs_by_distance.size() != aff_handles.size()
+         || names.pubs_by_name.size() != publications_map.size() ) { return false; }
+
+    //Year counts, the grid and the trigram index are taken as they are
+    if ( !in.read_array(year_tree) ) { return false; }
+    if ( !year_tree.empty() && year_tree.size() != std::numeric_limits<Year>::max() + 2u ) { return false; }
+    if ( (year_tree.empty() ? 0 : year_tree_prefix(year_tree.size() - 1)) != publications_map.size() ) { return false; }
+
+    std::vector<long long> grid_shape;
+    if ( !in.read_array(grid_shape, 6) || grid_shape[0] < 1 || grid_shape[0] > std::numeric_limits<int>::max() ) { return false; }
+    grid_cell_size = grid_shape[0];
+    grid_built_for = grid_shape[1];
+    grid_min = {static_cast<int>(grid_shape[2]), static_cast<int>(grid_shape[3])};
+    grid_max = {static_cast<int>(grid_shape[4]), static_cast<int>(grid_shape[5])};
+    if ( !in.read_buckets(grid, is_handle) ) { return false; }
+    std::size_t in_grid = 0;
+    for ( auto const& cell : grid ) { in_grid += cell.second.size(); }
+    if ( in_grid != aff_handles.size() ) { return false; }
+
+    std::vector<std::uint64_t> trigram_counts;
+    if ( !in.read_array(trigram_counts, 2) || !in.read_buckets(pub_trigrams, is_slot) ) { return false; }
+    pub_trigram_entries = trigram_counts[0];
+    pub_trigram_garbage = trigram_counts[1];
+    std::size_t in_trigrams = 0;
+    for ( auto const& t : pub_trigrams ) { in_trigrams += t.second.size(); }
+    if ( in_trigrams != pub_trigram_entries || pub_trigram_garbage > pub_trigram_entries ) { return false; }
+
+    //The ID lists and the ancestor and interval tables are rebuilt lazily
+    affIDList_valid = false;
+    pubIDList_valid = false;
+    ancestors_valid = false;
+    intervals_valid = false;
+    return true;
+}
+
+LoadStats Datastructures::load_text(const std::string &path, unsigned int threads)
+{
+    DS_TIME(load_text);
+    log_lost();
+    LoadStats stats;
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream in(path, std::ios::binary);
+    if ( !in ) { return stats; }
+    stats.opened = true;
+
+    if ( threads == 0 ) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+    std::vector<ParsedRecords> parts(threads);
+    std::vector<std::thread> workers;
+    //Records that refer to IDs further down the file
+    std::vector<PublicationRecord> deferred_publications;
+    std::vector<ReferenceRecord> deferred_references;
+
+    //chunk holds the unfinished last line of the previous read + the next read
+    std::string chunk;
+    std::size_t carried = 0;
+    while ( true ) {
+        chunk.resize(carried + LOAD_CHUNK_SIZE);
+        in.read(&chunk[carried], LOAD_CHUNK_SIZE);
+        std::size_t got = in.gcount();
+        stats.bytes += got;
+        chunk.resize(carried + got);
+        bool last = got < LOAD_CHUNK_SIZE;
+
+        std::size_t usable = chunk.size();
+        if ( !last ) {
+            auto nl = chunk.rfind('\n');
+            usable = nl == std::string::npos ? 0 : nl + 1;
+        }
+
+        //Cut the usable part into one piece per thread at line boundaries,
+        //the calling thread parses the first piece itself
+        std::string_view text(chunk.data(), usable);
+        std::vector<std::string_view> pieces;
+        for ( unsigned int t = 0; t < threads; ++t ) {
+            std::size_t end = t + 1 == threads ? text.size() : text.size() / (threads - t);
+            if ( end < text.size() ) {
+                auto nl = text.find('\n', end);
+                end = nl == std::string_view::npos ? text.size() : nl + 1;
+            }
+            pieces.push_back(text.substr(0, end));
+            text.remove_prefix(end);
+        }
+
+        workers.clear();
+        for ( unsigned int t = 0; t < threads; ++t ) {
+            parts[t] = {};
+            if ( t > 0 ) { workers.emplace_back(parse_lines, pieces[t], std::ref(parts[t])); }
+        }
+        parse_lines(pieces[0], parts[0]);
+        for ( auto& w : workers ) { w.join(); }
+
+        //Capacity for the whole chunk at once, then the records in file
+        //order, a run of records of the same kind at a time
+        std::size_t affiliations = 0;
+        std::size_t publications = 0;
+        for ( auto& part : parts ) {
+            affiliations += part.affiliations.size();
+            publications += part.publications.size();
+        }
+        aff_handles.reserve(aff_handles.size() + affiliations);
+        coord_to_id_map.reserve(coord_to_id_map.size() + affiliations);
+        if ( affIDList_valid ) { affIDList.reserve(affIDList.size() + affiliations); }
+        publications_map.reserve(publications_map.size() + publications);
+        if ( pubIDList_valid ) { pubIDList.reserve(pubIDList.size() + publications); }
+
+        for ( auto& part : parts ) {
+            stats.lines += part.lines;
+            stats.bad_lines += part.bad_lines;
+            auto a = part.affiliations.data();
+            auto p = part.publications.data();
+            auto r = part.references.data();
+            for ( std::size_t i = 0, run = 0; i < part.kinds.size(); i += run ) {
+                char kind = part.kinds[i];
+                for ( run = 1; i + run < part.kinds.size() && part.kinds[i + run] == kind; ++run ) {}
+                if ( kind == 'A' ) {
+                    stats.affiliations += add_affiliation_range(a, a + run);
+                    a += run;
+                }
+                else if ( kind == 'P' ) {
+                    stats.publications += add_publication_range(p, p + run, &deferred_publications);
+                    p += run;
+                }
+                else {
+                    stats.references += add_reference_range(r, r + run, &deferred_references);
+                    r += run;
+                }
+            }
+        }
+
+        if ( last ) { break; }
+        carried = chunk.size() - usable;
+        chunk.erase(0, usable);
+    }
+
+    //Every affiliation is in now, so publications kept aside go first and
+    //references after them. What still can't be added refers to nothing.
+    std::vector<PublicationRecord> missing_publications;
+    std::vector<ReferenceRecord> missing_references;
+    stats.publications += add_publication_range(deferred_publications.data(), deferred_publications.data() + deferred_publications.size(),
+                                                &missing_publications);
+    stats.references += add_reference_range(deferred_references.data(), deferred_references.data() + deferred_references.size(),
+                                            &missing_references);
+    stats.unresolved = missing_publications.size() + missing_references.size();
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+#ifdef DATASTRUCTURES_STATS
+void DatastructuresStats::record(Operation op, unsigned long long ns) const
+{
+    auto& data = operations_[op];
+    data.calls.fetch_add(1, std::memory_order_relaxed);
+    data.total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    std::size_t bucket = 0;
+    while ( ns > 1 && bucket + 1 < BUCKETS ) {
+        ns >>= 1;
+        ++bucket;
+    }
+    data.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void DatastructuresStats::reset()
+{
+    for ( auto& data : operations_ ) {
+        data.calls = 0;
+        data.total_ns = 0;
+        for ( auto& b : data.buckets ) { b = 0; }
+    }
+    for ( auto& c : counters_ ) { c = 0; }
+}
+
+const char *DatastructuresStats::name(Operation op)
+{
+#define DATASTRUCTURES_NAME_ENTRY(name) #name,
+    static char const* const names[] = { DATASTRUCTURES_TIMED_OPERATIONS(DATASTRUCTURES_NAME_ENTRY) };
+#undef DATASTRUCTURES_NAME_ENTRY
+    return names[op];
+}
+
+const char *DatastructuresStats::name(Counter c)
+{
+#define DATASTRUCTURES_NAME_ENTRY(name) #name,
+    static char const* const names[] = { DATASTRUCTURES_COUNTERS(DATASTRUCTURES_NAME_ENTRY) };
+#undef DATASTRUCTURES_NAME_ENTRY
+    return names[c];
+}
+
+namespace
+{
+//Upper bound (ns) of the bucket that contains the given fraction of calls
+unsigned long long latency_percentile(DatastructuresStats::OperationData const& data, double fraction)
+{
+    unsigned long long calls = data.calls.load(std::memory_order_relaxed);
+    unsigned long long seen = 0;
+    for ( std::size_t b = 0; b < DatastructuresStats::BUCKETS; ++b ) {
+        seen += data.buckets[b].load(std::memory_order_relaxed);
+        if ( seen >= fraction * calls ) { return 2ULL << b; }
+    }
+    return 2ULL << (DatastructuresStats::BUCKETS - 1);
+}
+
+struct ListLengths
+{
+    std::size_t max = 0;
+    double mean = 0;
+};
+
+template <typename Lists>
+ListLengths list_lengths(Lists const& lists)
+{
+    ListLengths result;
+    std::size_t total = 0;
+    for ( std::size_t i = 0; i < lists.size(); ++i ) {
+        std::size_t size = lists[i].size();
+        result.max = std::max(result.max, size);
+        total += size;
+    }
+    if ( !lists.empty() ) { result.mean = static_cast<double>(total) / lists.size(); }
+    return result;
+}
+}
+#endif
+
+std::string Datastructures::stats_text() const
+{
+    DS_TIME(stats_text);
+#ifdef DATASTRUCTURES_STATS
+    std::ostringstream out;
+    out << "operation calls mean_ns p50_ns p99_ns\n";
+    for ( int i = 0; i < DatastructuresStats::OPERATION_COUNT; ++i ) {
+        auto op = static_cast<DatastructuresStats::Operation>(i);
+        auto const& data = stats.ptr->operation(op);
+        unsigned long long calls = data.calls.load(std::memory_order_relaxed);
+        if ( calls == 0 ) { continue; }
+        out << DatastructuresStats::name(op) << " " << calls << " "
+            << data.total_ns.load(std::memory_order_relaxed) / calls << " "
+            << latency_percentile(data, 0.5) << " " << latency_percentile(data, 0.99) << "\n";
+    }
+
+    out << "\ncounters\n";
+    for ( int i = 0; i < DatastructuresStats::COUNTER_COUNT; ++i ) {
+        auto c = static_cast<DatastructuresStats::Counter>(i);
+        out << DatastructuresStats::name(c) << " " << stats.ptr->counter(c) << "\n";
+    }
+
+    out << "\nload factors\n"
+        << "aff_handles " << aff_handles.load_factor() << "\n"
+        << "publications_map " << publications_map.load_factor() << "\n"
+        << "coord_to_id_map " << coord_to_id_map.load_factor() << "\n"
+        << "grid " << grid.load_factor() << "\n";
+
+    out << "\nlist lengths (max mean)\n";
+    auto print = [&](char const* name, ListLengths l) { out << name << " " << l.max << " " << l.mean << "\n"; };
+    print("aff_pubs", list_lengths(aff_pubs));
+    print("pub_affs", list_lengths(pub_affs));
+    print("pub_refs", list_lengths(pub_refs));
+    return out.str();
+#else
+    return "statistics disabled, compile with DATASTRUCTURES_STATS\n";
+#endif
+}
+
+std::string Datastructures::stats_json() const
+{
+    DS_TIME(stats_json);
+#ifdef DATASTRUCTURES_STATS
+    std::ostringstream out;
+    out << "{\"operations\":{";
+    bool first = true;
+    for ( int i = 0; i < DatastructuresStats::OPERATION_COUNT; ++i ) {
+        auto op = static_cast<DatastructuresStats::Operation>(i);
+        auto const& data = stats.ptr->operation(op);
+        unsigned long long calls = data.calls.load(std::memory_order_relaxed);
+        if ( calls == 0 ) { continue; }
+        out << (first ? "" : ",") << "\"" << DatastructuresStats::name(op) << "\":{\"calls\":" << calls
+            << ",\"total_ns\":" << data.total_ns.load(std::memory_order_relaxed) << ",\"histogram_log2_ns\":[";
+        for ( std::size_t b = 0; b < DatastructuresStats::BUCKETS; ++b ) {
+            out << (b ? "," : "") << data.buckets[b].load(std::memory_order_relaxed);
+        }
+        out << "]}";
+        first = false;
+    }
+
+    out << "},\"counters\":{";
+    for ( int i = 0; i < DatastructuresStats::COUNTER_COUNT; ++i ) {
+        auto c = static_cast<DatastructuresStats::Counter>(i);
+        out << (i ? "," : "") << "\"" << DatastructuresStats::name(c) << "\":" << stats.ptr->counter(c);
+    }
+
+    out << "},\"load_factors\":{"
+        << "\"aff_handles\":" << aff_handles.load_factor()
+        << ",\"publications_map\":" << publications_map.load_factor()
+        << ",\"coord_to_id_map\":" << coord_to_id_map.load_factor()
+        << ",\"grid\":" << grid.load_factor();
+
+    out << "},\"list_lengths\":{";
+    auto print = [&](char const* name, ListLengths l, bool last)
+    {
+        out << "\"" << name << "\":{\"max\":" << l.max << ",\"mean\":" << l.mean << "}" << (last ? "" : ",");
+    };
+    print("aff_pubs", list_lengths(aff_pubs), false);
+    print("pub_affs", list_lengths(pub_affs), false);
+    print("pub_refs", list_lengths(pub_refs), true);
+    out << "}}";
+    return out.str();
+#else
+    return "{}";
+#endif
+}
+
+void Datastructures::reset_stats()
+{
+    DS_TIME(reset_stats);
+#ifdef DATASTRUCTURES_STATS
+    stats.ptr->reset();
+#endif
+}
+
+void Datastructures::list_affiliation(AffHandle h)
+{
+    if ( !affIDList_valid ) { return; }
+    aff_list_pos[h] = affIDList.size();
+    affIDList.push_back(aff_ids[h]);
+}
+
+void Datastructures::unlist_affiliation(AffHandle h)
+{
+    if ( !affIDList_valid ) { return; }
+
+    //Last ID takes the removed one's place
+    auto pos = aff_list_pos[h];
+    if ( pos + 1 != affIDList.size() ) {
+        affIDList[pos] = std::move(affIDList.back());
+        aff_list_pos[find_handle(affIDList[pos])] = pos;
+    }
+    affIDList.pop_back();
+}
+
+void Datastructures::list_publication(PubSlot s)
+{
+    if ( !pubIDList_valid ) { return; }
+    pub_list_pos[s] = pubIDList.size();
+    pubIDList.push_back(pub_ids[s]);
+}
+
+void Datastructures::unlist_publication(PubSlot s)
+{
+    if ( !pubIDList_valid ) { return; }
+
+    auto pos = pub_list_pos[s];
+    if ( pos + 1 != pubIDList.size() ) {
+        pubIDList[pos] = pubIDList.back();
+        pub_list_pos[find_slot(pubIDList[pos])] = pos;
+    }
+    pubIDList.pop_back();
+}
+
+void Datastructures::link_affiliation(AffHandle h, PubSlot s)
+{
+    //Weights count publications, so an affiliation listed twice changes nothing
+    auto others = distinct_affiliations(s, pub_affs[s].size());
+    if ( !std::binary_search(others.begin(), others.end(), h) ) {
+        for ( auto g : others ) {
+            change_link_weight(h, g, 1);
+            change_link_weight(g, h, 1);
+        }
+    }
+    aff_pub_pos[h].push_back(pub_affs[s].size());
+    pub_aff_pos[s].push_back(aff_pubs[h].size());
+    aff_pubs[h].push_back(s);
+    pub_affs[s].push_back(h);
+    year_index_insert(h, s);
+}
+
+void Datastructures::unlink_affiliation(PubSlot s, unsigned int j)
+{
+    AffHandle h = pub_affs[s][j];
+    unsigned int i = pub_aff_pos[s][j];
+
+    auto others = distinct_affiliations(s, j);
+    if ( !std::binary_search(others.begin(), others.end(), h) ) {
+        for ( auto g : others ) {
+            change_link_weight(h, g, -1);
+            change_link_weight(g, h, -1);
+        }
+    }
+
+    //Swap with the last entry on both sides, the moved entries' mirrors
+    //are told their new position
+    auto pubs = aff_pubs[h];
+    auto pubs_pos = aff_pub_pos[h];
+    if ( i + 1 != pubs.size() ) {
+        pubs[i] = pubs.back();
+        pubs_pos[i] = pubs_pos.back();
+        pub_aff_pos[pubs[i]][pubs_pos[i]] = i;
+    }
+    pubs.pop_back();
+    pubs_pos.pop_back();
+
+    auto affs = pub_affs[s];
+    auto affs_pos = pub_aff_pos[s];
+    if ( j + 1 != affs.size() ) {
+        affs[j] = affs.back();
+        affs_pos[j] = affs_pos.back();
+        aff_pub_pos[affs[j]][affs_pos[j]] = j;
+    }
+    affs.pop_back();
+    affs_pos.pop_back();
+}
+
+void Datastructures::unlink_reference(PubSlot child)
+{
+    PubSlot parent = pub_parents[child];
+    if ( parent == NO_SLOT ) { return; }
+
+    auto refs = pub_refs[parent];
+    auto pos = pub_ref_pos[child];
+    if ( pos + 1 != refs.size() ) {
+        refs[pos] = refs.back();
+        pub_ref_pos[refs[pos]] = pos;
+    }
+    refs.pop_back();
+    pub_parents[child] = NO_SLOT;
+}
+
+unsigned int Datastructures::remove_publications(const std::vector<PublicationID> &publications)
+{
+    DS_TIME(remove_publications);
+    //Each remove_publication goes to the update log on its own
+    unsigned int removed = 0;
+    for ( auto id : publications ) {
+        if ( remove_publication(id) ) { ++removed; }
+    }
+    return removed;
+}
+
+std::vector<AffiliationID> Datastructures::find_affiliations_by_prefix(const Name &prefix) const
+{
+    DS_TIME(find_affiliations_by_prefix);
+    std::vector<AffiliationID> found;
+    for ( auto it = names.affs_by_name.lower_bound(std::string_view(prefix)); it != names.affs_by_name.end(); ++it ) {
+        if ( name_of(names.affs[*it]).substr(0, prefix.size()) != prefix ) { break; }
+        found.push_back(aff_ids[*it]);
+    }
+    return found;
+}
+
+std::vector<AffiliationID> Datastructures::find_affiliations_by_name(const Name &name) const
+{
+    DS_TIME(find_affiliations_by_name);
+    std::vector<AffiliationID> found;
+    auto range = names.affs_by_name.equal_range(std::string_view(name));
+    for ( auto it = range.first; it != range.second; ++it ) {
+        found.push_back(aff_ids[*it]);
+    }
+    return found;
+}
+
+std::vector<PublicationID> Datastructures::find_publications_by_name(const Name &name) const
+{
+    DS_TIME(find_publications_by_name);
+    std::vector<PublicationID> found;
+    auto range = names.pubs_by_name.equal_range(std::string_view(name));
+    for ( auto it = range.first; it != range.second; ++it ) {
+        found.push_back(pub_ids[*it]);
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+std::vector<PublicationID> Datastructures::find_publications_by_substring(const Name &substring) const
+{
+    DS_TIME(find_publications_by_substring);
+    std::vector<PublicationID> found;
+    auto matches = [&](PubSlot s)
+    {
+        return pub_ids[s] != NO_PUBLICATION && name_of(names.pubs[s]).find(substring) != std::string_view::npos;
+    };
+
+    //Too short to have a trigram, every name has to be checked
+    if ( substring.size() < 3 ) {
+        for ( PubSlot s = 0; s < pub_ids.size(); ++s ) {
+            if ( matches(s) ) { found.push_back(pub_ids[s]); }
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    //Every match contains all trigrams of substring, the rarest one gives the fewest candidates
+    std::pmr::vector<PubSlot> const* candidates = nullptr;
+    for ( std::size_t i = 0; i + 3 <= substring.size(); ++i ) {
+        auto it = pub_trigrams.find(trigram(substring.data() + i));
+        if ( it == pub_trigrams.end() ) { return found; }
+        if ( candidates == nullptr || it->second.size() < candidates->size() ) { candidates = &it->second; }
+    }
+
+    //A reused slot can be listed twice
+    for ( auto s : *candidates ) {
+        if ( matches(s) ) { found.push_back(pub_ids[s]); }
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+void Datastructures::index_publication_name(PubSlot s)
+{
+    auto name = name_of(names.pubs[s]);
+    names.pubs_by_name.insert(s);
+    for_each_trigram(name, [&](std::uint32_t t)
+    {
+        pub_trigrams[t].push_back(s);
+        ++pub_trigram_entries;
+    });
+}
+
+void Datastructures::unindex_publication_name(PubSlot s)
+{
+    auto name = name_of(names.pubs[s]);
+    names.pubs_by_name.erase(s);
+    for_each_trigram(name, [&](std::uint32_t) { ++pub_trigram_garbage; });
+}
+
+void Datastructures::pub_trigrams_rebuild()
+{
+    pub_trigrams.clear();
+    pub_trigram_entries = 0;
+    pub_trigram_garbage = 0;
+    for ( PubSlot s = 0; s < pub_ids.size(); ++s ) {
+        if ( pub_ids[s] == NO_PUBLICATION ) { continue; }
+        for_each_trigram(name_of(names.pubs[s]), [&](std::uint32_t t)
+        {
+            pub_trigrams[t].push_back(s);
+            ++pub_trigram_entries;
+        });
+    }
+}
+
+namespace
+{
+//Work arrays of the path searches, kept between queries (one set per thread)
+//so that a search allocates nothing once they have grown to the graph size.
+//A handle's entries are only valid if its stamp is the current generation,
+//which makes starting a new search O(1).
+struct PathScratch
+{
+    std::vector<unsigned int> stamp;
+    std::vector<Datastructures::AffHandle> prev;
+    std::vector<unsigned long long> best;
+    std::vector<Datastructures::AffHandle> queue;
+    std::vector<std::pair<unsigned long long, Datastructures::AffHandle>> heap;
+    unsigned int generation = 0;
+
+    void start(std::size_t handles)
+    {
+        if ( stamp.size() < handles ) {
+            stamp.resize(handles, 0);
+            prev.resize(handles);
+            best.resize(handles);
+        }
+        if ( ++generation == 0 ) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        queue.clear();
+        heap.clear();
+    }
+
+    bool seen(Datastructures::AffHandle h) const { return stamp[h] == generation; }
+
+    void reach(Datastructures::AffHandle h, Datastructures::AffHandle from, unsigned long long value)
+    {
+        stamp[h] = generation;
+        prev[h] = from;
+        best[h] = value;
+    }
+};
+
+thread_local PathScratch path_scratch;
+
+//Length of a connection, the distance rounded down
+Distance connection_length(Coord c1, Coord c2)
+{
+    auto d = static_cast<unsigned long long>(std::sqrt(static_cast<long double>(squared_distance(c1, c2))));
+    return static_cast<Distance>(std::min<unsigned long long>(d, std::numeric_limits<Distance>::max()));
+}
+}
+
+std::vector<Connection> Datastructures::get_connected_affiliations(AffiliationID id) const
+{
+    DS_TIME(get_connected_affiliations);
+    AffHandle h = find_handle(id);
+    if ( h == NO_HANDLE ) { return {NO_CONNECTION}; }
+
+    std::vector<Connection> connections;
+    connections.reserve(aff_links[h].size());
+    for ( auto const& link : aff_links[h] ) { connections.push_back({aff_ids[h], aff_ids[link.first], link.second}); }
+    std::sort(connections.begin(), connections.end(), [](Connection const& c1, Connection const& c2)
+    {
+        return c1.aff2 < c2.aff2;
+    });
+    return connections;
+}
+
+std::vector<Connection> Datastructures::get_all_connections() const
+{
+    DS_TIME(get_all_connections);
+    std::vector<Connection> connections;
+    connections.reserve(link_pos.size() / 2);
+    for ( AffHandle h = 0; h < aff_links.size(); ++h ) {
+        for ( auto const& link : aff_links[h] ) {
+            if ( aff_ids[h] < aff_ids[link.first] ) { connections.push_back({aff_ids[h], aff_ids[link.first], link.second}); }
+        }
+    }
+    std::sort(connections.begin(), connections.end(), [](Connection const& c1, Connection const& c2)
+    {
+        return std::tie(c1.aff1, c1.aff2) < std::tie(c2.aff1, c2.aff2);
+    });
+    return connections;
+}
+
+Path Datastructures::get_any_path(AffiliationID source, AffiliationID target) const
+{
+    DS_TIME(get_any_path);
+    return get_path_with_least_affiliations(source, target);
+}
+
+Path Datastructures::get_path_with_least_affiliations(AffiliationID source, AffiliationID target) const
+{
+    DS_TIME(get_path_with_least_affiliations);
+    AffHandle from = find_handle(source);
+    AffHandle to = find_handle(target);
+    if ( from == NO_HANDLE || to == NO_HANDLE ) { return {NO_CONNECTION}; }
+
+    //Breadth-first, queue is read from the front by index
+    auto& scratch = path_scratch;
+    scratch.start(aff_ids.size());
+    scratch.reach(from, NO_HANDLE, 0);
+    scratch.queue.push_back(from);
+    for ( std::size_t i = 0; i < scratch.queue.size() && !scratch.seen(to); ++i ) {
+        AffHandle h = scratch.queue[i];
+        for ( auto const& link : aff_links[h] ) {
+            if ( scratch.seen(link.first) ) { continue; }
+            scratch.reach(link.first, h, 0);
+            scratch.queue.push_back(link.first);
+        }
+    }
+    if ( !scratch.seen(to) ) { return {}; }
+    return path_to(from, to, scratch.prev);
+}
+
+Path Datastructures::get_path_of_least_friction(AffiliationID source, AffiliationID target) const
+{
+    DS_TIME(get_path_of_least_friction);
+    AffHandle from = find_handle(source);
+    AffHandle to = find_handle(target);
+    if ( from == NO_HANDLE || to == NO_HANDLE ) { return {NO_CONNECTION}; }
+    if ( from == to ) { return {}; }
+
+    //Widest path: best[h] is the strongest weakest link of any path to h.
+    //Max-heap, so the first time target is popped its value is final.
+    auto& scratch = path_scratch;
+    scratch.start(aff_ids.size());
+    const auto unlimited = std::numeric_limits<unsigned long long>::max();
+    scratch.reach(from, NO_HANDLE, unlimited);
+    scratch.heap.push_back({unlimited, from});
+    unsigned long long widest = 0;
+    while ( !scratch.heap.empty() ) {
+        std::pop_heap(scratch.heap.begin(), scratch.heap.end());
+        auto [width, h] = scratch.heap.back();
+        scratch.heap.pop_back();
+        if ( width < scratch.best[h] ) { continue; }
+        if ( h == to ) {
+            widest = width;
+            break;
+        }
+        for ( auto const& link : aff_links[h] ) {
+            auto w = std::min<unsigned long long>(width, link.second);
+            if ( scratch.seen(link.first) && scratch.best[link.first] >= w ) { continue; }
+            scratch.reach(link.first, h, w);
+            scratch.heap.push_back({w, link.first});
+            std::push_heap(scratch.heap.begin(), scratch.heap.end());
+        }
+    }
+    if ( widest == 0 ) { return {}; }
+
+    //Fewest affiliations using only connections at least that strong
+    scratch.start(aff_ids.size());
+    scratch.reach(from, NO_HANDLE, 0);
+    scratch.queue.push_back(from);
+    for ( std::size_t i = 0; i < scratch.queue.size() && !scratch.seen(to); ++i ) {
+        AffHandle h = scratch.queue[i];
+        for ( auto const& link : aff_links[h] ) {
+            if ( static_cast<unsigned long long>(link.second) < widest || scratch.seen(link.first) ) { continue; }
+            scratch.reach(link.first, h, 0);
+            scratch.queue.push_back(link.first);
+        }
+    }
+    return path_to(from, to, scratch.prev);
+}
+
+PathWithDist Datastructures::get_shortest_path(AffiliationID source, AffiliationID target) const
+{
+    DS_TIME(get_shortest_path);
+    AffHandle from = find_handle(source);
+    AffHandle to = find_handle(target);
+    if ( from == NO_HANDLE || to == NO_HANDLE ) { return {{NO_CONNECTION, NO_DISTANCE}}; }
+
+    //Dijkstra, min-heap through greater<>, stale heap entries are skipped
+    auto& scratch = path_scratch;
+    scratch.start(aff_ids.size());
+    auto later = std::greater<std::pair<unsigned long long, AffHandle>>();
+    scratch.reach(from, NO_HANDLE, 0);
+    scratch.heap.push_back({0, from});
+    while ( !scratch.heap.empty() ) {
+        std::pop_heap(scratch.heap.begin(), scratch.heap.end(), later);
+        auto [dist, h] = scratch.heap.back();
+        scratch.heap.pop_back();
+        if ( dist > scratch.best[h] ) { continue; }
+        if ( h == to ) { break; }
+        for ( auto const& link : aff_links[h] ) {
+            auto d = dist + connection_length(aff_coord(h), aff_coord(link.first));
+            if ( scratch.seen(link.first) && scratch.best[link.first] <= d ) { continue; }
+            scratch.reach(link.first, h, d);
+            scratch.heap.push_back({d, link.first});
+            std::push_heap(scratch.heap.begin(), scratch.heap.end(), later);
+        }
+    }
+    if ( !scratch.seen(to) ) { return {}; }
+
+    //Lengths again from the handles, path_to gives the connections in the same order
+    std::vector<Distance> lengths;
+    for ( AffHandle h = to; h != from; h = scratch.prev[h] ) {
+        lengths.push_back(connection_length(aff_coord(scratch.prev[h]), aff_coord(h)));
+    }
+    std::reverse(lengths.begin(), lengths.end());
+
+    PathWithDist path;
+    auto connections = path_to(from, to, scratch.prev);
+    path.reserve(connections.size());
+    for ( std::size_t i = 0; i < connections.size(); ++i ) { path.push_back({std::move(connections[i]), lengths[i]}); }
+    return path;
+}
+
+Path Datastructures::path_to(AffHandle source, AffHandle target, const std::vector<AffHandle> &prev) const
+{
+    Path path;
+    for ( AffHandle h = target; h != source; h = prev[h] ) {
+        path.push_back({aff_ids[prev[h]], aff_ids[h], link_weight(prev[h], h)});
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+void Datastructures::change_link_weight(AffHandle h, AffHandle g, Weight delta)
+{
+    auto links = aff_links[h];
+    auto i = link_pos.find(link_key(h, g));
+    if ( i == link_pos.end() ) {
+        link_pos[link_key(h, g)] = links.size();
+        links.push_back({g, delta});
+        return;
+    }
+
+    unsigned int pos = i->second;
+    links[pos].second += delta;
+    if ( links[pos].second != 0 ) { return; }
+
+    //No publications in common any more, swap with the last link
+    link_pos.erase(i);
+    if ( pos + 1 != links.size() ) {
+        links[pos] = links.back();
+        link_pos[link_key(h, links[pos].first)] = pos;
+    }
+    links.pop_back();
+}
+
+Weight Datastructures::link_weight(AffHandle h, AffHandle g) const
+{
+    auto i = link_pos.find(link_key(h, g));
+    if ( i == link_pos.end() ) { return NO_WEIGHT; }
+    return aff_links[h][i->second].second;
+}
+
+void Datastructures::links_rebuild()
+{
+    aff_links.clear();
+    aff_links.resize(aff_ids.size());
+    link_pos.clear();
+    for ( PubSlot s = 0; s < pub_ids.size(); ++s ) {
+        auto affs = distinct_affiliations(s, pub_affs[s].size());
+        for ( std::size_t i = 0; i < affs.size(); ++i ) {
+            for ( std::size_t j = i + 1; j < affs.size(); ++j ) {
+                change_link_weight(affs[i], affs[j], 1);
+                change_link_weight(affs[j], affs[i], 1);
+            }
+        }
+    }
+}
+
+std::vector<Datastructures::AffHandle> Datastructures::distinct_affiliations(PubSlot s, unsigned int skip) const
+{
+    std::vector<AffHandle> affs;
+    affs.reserve(pub_affs[s].size());
+    for ( unsigned int i = 0; i < pub_affs[s].size(); ++i ) {
+        if ( i != skip ) { affs.push_back(pub_affs[s][i]); }
+    }
+    std::sort(affs.begin(), affs.end());
+    affs.erase(std::unique(affs.begin(), affs.end()), affs.end());
+    return affs;
+}
+
+unsigned int Datastructures::get_publication_count_between(AffiliationID affiliationid, Year from, Year to) const
+{
+    DS_TIME(get_publication_count_between);
+    AffHandle h = find_handle(affiliationid);
+    if ( h == NO_HANDLE ) { return 0; }
+
+    auto [first, last] = year_range(h, from, to);
+    return last - first;
+}
+
+unsigned int Datastructures::get_total_publication_count_between(Year from, Year to) const
+{
+    DS_TIME(get_total_publication_count_between);
+    if ( from > to ) { return 0; }
+    return year_tree_prefix(to + 1u) - year_tree_prefix(from);
+}
+
+std::vector<std::pair<AffiliationID, unsigned int>> Datastructures::get_top_affiliations_between(Year from, Year to, unsigned int k) const
+{
+    DS_TIME(get_top_affiliations_between);
+    //Counts straight from the year index, the publications aren't looked at
+    std::vector<std::pair<unsigned int, AffHandle>> counts;
+    for ( AffHandle h = 0; h < aff_ids.size(); ++h ) {
+        if ( aff_ids[h] == NO_AFFILIATION ) { continue; }
+        auto [first, last] = year_range(h, from, to);
+        if ( first != last ) { counts.push_back({static_cast<unsigned int>(last - first), h}); }
+    }
+
+    auto more = [this](std::pair<unsigned int, AffHandle> const& c1, std::pair<unsigned int, AffHandle> const& c2)
+    {
+        if ( c1.first != c2.first ) { return c1.first > c2.first; }
+        return aff_ids[c1.second] < aff_ids[c2.second];
+    };
+    std::size_t count = std::min<std::size_t>(k, counts.size());
+    std::partial_sort(counts.begin(), counts.begin() + count, counts.end(), more);
+
+    std::vector<std::pair<AffiliationID, unsigned int>> top;
+    top.reserve(count);
+    for ( std::size_t i = 0; i < count; ++i ) { top.push_back({aff_ids[counts[i].second], counts[i].first}); }
+    return top;
+}
+
+std::pair<std::pair<Year, Datastructures::PubSlot> const*, std::pair<Year, Datastructures::PubSlot> const*>
+Datastructures::year_range(AffHandle h, Year from, Year to) const
+{
+    //aff_years is kept sorted by year, or if same year, by name,
+    //so the range is found with two binary searches.
+    const auto index = aff_years[h];
+    auto first = std::lower_bound(index.begin(), index.end(), from,
+                                  [](auto const& entry, Year y) { return entry.first < y; });
+    auto last = std::upper_bound(first, index.end(), to,
+                                 [](Year y, auto const& entry) { return y < entry.first; });
+    return {first, last};
+}
+
+void Datastructures::year_tree_add(Year year, int delta)
+{
+    if ( year_tree.empty() ) { year_tree.assign(std::numeric_limits<Year>::max() + 2, 0); }
+    for ( std::size_t i = year + 1u; i < year_tree.size(); i += i & (~i + 1) ) { year_tree[i] += delta; }
+}
+
+unsigned int Datastructures::year_tree_prefix(unsigned int years) const
+{
+    //Publications with year < years
+    unsigned int sum = 0;
+    if ( year_tree.empty() ) { return 0; }
+    for ( std::size_t i = years; i > 0; i -= i & (~i + 1) ) { sum += year_tree[i]; }
+    return sum;
+}
+
+std::vector<PublicationInfluence> Datastructures::get_top_publications_by_influence(unsigned int k, unsigned int threads) const
+{
+    DS_TIME(get_top_publications_by_influence);
+    if ( threads == 0 ) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+
+    //CSR snapshot of the live publications, numbered 0..n-1. refs holds
+    //the references of each publication, citers the other direction.
+    std::vector<PubSlot> slots;
+    std::vector<unsigned int> index(pub_ids.size(), 0);
+    for ( PubSlot s = 0; s < pub_ids.size(); ++s ) {
+        if ( pub_ids[s] == NO_PUBLICATION ) { continue; }
+        index[s] = slots.size();
+        slots.push_back(s);
+    }
+    const std::size_t n = slots.size();
+    if ( n == 0 || k == 0 ) { return {}; }
+
+    std::vector<unsigned int> ref_offsets(n + 1, 0);
+    std::vector<unsigned int> refs;
+    std::vector<unsigned int> citer_offsets(n + 1, 0);
+    for ( std::size_t v = 0; v < n; ++v ) {
+        for ( auto r : pub_refs[slots[v]] ) {
+            refs.push_back(index[r]);
+            ++citer_offsets[index[r] + 1];
+        }
+        ref_offsets[v + 1] = refs.size();
+    }
+    for ( std::size_t v = 0; v < n; ++v ) { citer_offsets[v + 1] += citer_offsets[v]; }
+    std::vector<unsigned int> citers(refs.size());
+    {
+        std::vector<unsigned int> fill(citer_offsets.begin(), citer_offsets.end() - 1);
+        for ( std::size_t v = 0; v < n; ++v ) {
+            for ( auto i = ref_offsets[v]; i < ref_offsets[v + 1]; ++i ) { citers[fill[refs[i]]++] = v; }
+        }
+    }
+
+    //Transitive citations in topological order (citers first). Every
+    //publication has at most one citer in the forest, so nothing is counted twice.
+    std::vector<unsigned int> transitive(n, 0);
+    std::vector<unsigned int> order;
+    order.reserve(n);
+    for ( std::size_t v = 0; v < n; ++v ) {
+        if ( citer_offsets[v] == citer_offsets[v + 1] ) { order.push_back(v); }
+    }
+    for ( std::size_t i = 0; i < order.size(); ++i ) {
+        auto u = order[i];
+        for ( auto j = ref_offsets[u]; j < ref_offsets[u + 1]; ++j ) {
+            transitive[refs[j]] += transitive[u] + 1;
+            order.push_back(refs[j]);
+        }
+    }
+
+    //PageRank, pulled from the citers so that every thread writes only its
+    //own range. Publications without references spread their score evenly.
+    const double damping = 0.85;
+    const double epsilon = 1e-10;
+    const unsigned int max_iterations = 100;
+    std::vector<double> rank(n, 1.0 / n);
+    std::vector<double> next(n);
+    std::vector<double> dangling_part(threads);
+    std::vector<double> change_part(threads);
+    double dangling = 0;
+    for ( std::size_t v = 0; v < n; ++v ) {
+        if ( ref_offsets[v] == ref_offsets[v + 1] ) { dangling += rank[v]; }
+    }
+    unsigned int iteration = 0;
+    double base = (1 - damping) / n + damping * dangling / n;
+    parallel_rounds(n, threads, [&](std::size_t begin, std::size_t end, std::size_t t)
+    {
+        double dangling_sum = 0;
+        double change = 0;
+        for ( std::size_t v = begin; v < end; ++v ) {
+            double sum = 0;
+            for ( auto i = citer_offsets[v]; i < citer_offsets[v + 1]; ++i ) {
+                auto u = citers[i];
+                sum += rank[u] / (ref_offsets[u + 1] - ref_offsets[u]);
+            }
+            next[v] = base + damping * sum;
+            change += std::abs(next[v] - rank[v]);
+            if ( ref_offsets[v] == ref_offsets[v + 1] ) { dangling_sum += next[v]; }
+        }
+        dangling_part[t] = dangling_sum;
+        change_part[t] = change;
+    },
+    [&](std::size_t chunks)
+    {
+        //Between iterations, the threads are waiting
+        rank.swap(next);
+        dangling = 0;
+        double change = 0;
+        for ( std::size_t t = 0; t < chunks; ++t ) {
+            dangling += dangling_part[t];
+            change += change_part[t];
+        }
+        base = (1 - damping) / n + damping * dangling / n;
+        return change >= epsilon && ++iteration < max_iterations;
+    });
+
+    //Top k by score
+    std::vector<unsigned int> top(n);
+    for ( std::size_t v = 0; v < n; ++v ) { top[v] = v; }
+    std::size_t count = std::min<std::size_t>(k, n);
+    std::partial_sort(top.begin(), top.begin() + count, top.end(), [&](unsigned int v1, unsigned int v2)
+    {
+        if ( rank[v1] != rank[v2] ) { return rank[v1] > rank[v2]; }
+        return pub_ids[slots[v1]] < pub_ids[slots[v2]];
+    });
+
+    std::vector<PublicationInfluence> influence;
+    influence.reserve(count);
+    for ( std::size_t i = 0; i < count; ++i ) {
+        auto v = top[i];
+        influence.push_back({pub_ids[slots[v]], ref_offsets[v + 1] - ref_offsets[v], transitive[v], rank[v]});
+    }
+    return influence;
+}
+
+namespace
+{
+template <typename T, typename Allocator>
+std::size_t vector_bytes(std::vector<T, Allocator> const& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+//Heap part of a string, zero when it fits in the string object itself
+std::size_t string_bytes(std::string const& s)
+{
+    static const std::size_t inline_capacity = std::string().capacity();
+    return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+}
+
+//Node estimates: a tree node is the value plus colour and three pointers,
+//a hash node the value plus a next pointer and the cached hash.
+template <typename Set>
+std::size_t tree_bytes(Set const& set)
+{
+    return set.size() * (sizeof(typename Set::value_type) + 4 * sizeof(void*));
+}
+
+template <typename Map>
+std::size_t hash_bytes(Map const& map)
+{
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*));
+}
+}
+
+MemoryUsage Datastructures::memory_usage() const
+{
+    DS_TIME(memory_usage);
+    MemoryUsage usage;
+
+    usage.maps = hash_bytes(aff_handles) + publications_map.memory_bytes() + coord_to_id_map.memory_bytes()
+            + link_pos.memory_bytes();
+
+    usage.id_lists = vector_bytes(aff_ids) + vector_bytes(pub_ids) + vector_bytes(affIDList) + vector_bytes(pubIDList)
+            + vector_bytes(free_handles) + vector_bytes(free_slots);
+
+    usage.columns = vector_bytes(aff_x) + vector_bytes(aff_y) + vector_bytes(names.affs) + vector_bytes(aff_list_pos)
+            + vector_bytes(pub_years) + vector_bytes(pub_parents) + vector_bytes(names.pubs) + vector_bytes(pub_list_pos)
+            + vector_bytes(pub_ref_pos);
+
+    usage.adjacency = aff_pubs.memory_bytes() + aff_pub_pos.memory_bytes() + aff_years.memory_bytes()
+            + pub_affs.memory_bytes() + pub_aff_pos.memory_bytes() + pub_refs.memory_bytes() + aff_links.memory_bytes();
+
+    usage.strings = names.pool.capacity();
+    for ( auto const& id : aff_ids ) { usage.strings += string_bytes(id); }
+    for ( auto const& id : affIDList ) { usage.strings += string_bytes(id); }
+    for ( auto const& a : aff_handles ) { usage.strings += string_bytes(a.first); }
+
+    usage.indexes = tree_bytes(names.affs_by_name) + tree_bytes(affs_by_distance) + tree_bytes(names.pubs_by_name)
+            + hash_bytes(grid) + hash_bytes(pub_trigrams) + vector_bytes(year_tree) + vector_bytes(lift)
+            + vector_bytes(pub_depth) + vector_bytes(dfs_order) + vector_bytes(pre_order) + vector_bytes(subtree_end);
+    for ( auto const& cell : grid ) { usage.indexes += vector_bytes(cell.second); }
+    for ( auto const& postings : pub_trigrams ) { usage.indexes += vector_bytes(postings.second); }
+    for ( auto const& row : lift ) { usage.indexes += vector_bytes(row); }
+
+    return usage;
+}
+
+namespace
+{
+//Rows kept[0], kept[1]... of column become rows 0, 1..., with no spare capacity
+template <typename T, typename Allocator>
+void keep_rows(std::vector<T, Allocator>& column, std::vector<unsigned int> const& kept)
+{
+    std::vector<T, Allocator> packed(column.get_allocator());
+    packed.reserve(kept.size());
+    for ( auto i : kept ) { packed.push_back(std::move(column[i])); }
+    column.swap(packed);
+}
+}
+
+void Datastructures::compact()
+{
+    DS_TIME(compact);
+    //Renumbers everything, the snapshot is copied instead
+    log_lost();
+
+    //Live handles and slots are renumbered 0, 1... in their old order, so the
+    //columns lose the rows of removed ones and the orders that break ties by
+    //handle stay the same. kept_* list the old numbers, *_of map old to new.
+    std::vector<unsigned int> kept_affs;
+    std::vector<AffHandle> handle_of(aff_ids.size(), NO_HANDLE);
+    for ( AffHandle h = 0; h < aff_ids.size(); ++h ) {
+        if ( aff_ids[h] == NO_AFFILIATION ) { continue; }
+        handle_of[h] = kept_affs.size();
+        kept_affs.push_back(h);
+    }
+    std::vector<unsigned int> kept_pubs;
+    std::vector<PubSlot> slot_of(pub_ids.size(), NO_SLOT);
+    for ( PubSlot s = 0; s < pub_ids.size(); ++s ) {
+        if ( pub_ids[s] == NO_PUBLICATION ) { continue; }
+        slot_of[s] = kept_pubs.size();
+        kept_pubs.push_back(s);
+    }
+    auto new_handle_of = [&](AffHandle h) { return handle_of[h]; };
+    auto new_slot_of = [&](PubSlot s) { return s == NO_SLOT ? NO_SLOT : slot_of[s]; };
+
+    //Node containers are copied out (renumbered) so that the whole arena can
+    //be released. The name indexes compare through the name columns, so they
+    //have to be empty before the columns change.
+    std::vector<std::pair<AffiliationID, AffHandle>> handles;
+    handles.reserve(aff_handles.size());
+    for ( auto& a : aff_handles ) { handles.push_back({std::move(a.first), new_handle_of(a.second)}); }
+    std::vector<AffHandle> by_name;
+    by_name.reserve(names.affs_by_name.size());
+    for ( auto h : names.affs_by_name ) { by_name.push_back(new_handle_of(h)); }
+    std::vector<std::tuple<unsigned long long, int, AffHandle>> by_distance;
+    by_distance.reserve(affs_by_distance.size());
+    for ( auto const& a : affs_by_distance ) { by_distance.push_back({std::get<0>(a), std::get<1>(a), new_handle_of(std::get<2>(a))}); }
+    std::vector<PubSlot> pubs_named;
+    pubs_named.reserve(names.pubs_by_name.size());
+    for ( auto s : names.pubs_by_name ) { pubs_named.push_back(new_slot_of(s)); }
+    //The ID strings wait outside the arena, the indexes in it are rebuilt below
+    std::vector<AffiliationID> ids;
+    ids.reserve(kept_affs.size());
+    for ( auto h : kept_affs ) { ids.push_back(std::move(aff_ids[h])); }
+    std::vector<AffiliationID> listed(std::make_move_iterator(affIDList.begin()), std::make_move_iterator(affIDList.end()));
+    reset_container(aff_handles);
+    reset_container(aff_ids);
+    reset_container(affIDList);
+    reset_container(names.affs_by_name);
+    reset_container(affs_by_distance);
+    reset_container(names.pubs_by_name);
+    reset_container(pub_trigrams);
+    reset_container(grid);
+    arena.pool.release();
+
+    //Columns
+    aff_ids.assign(std::make_move_iterator(ids.begin()), std::make_move_iterator(ids.end()));
+    affIDList.assign(std::make_move_iterator(listed.begin()), std::make_move_iterator(listed.end()));
+    keep_rows(aff_x, kept_affs);
+    keep_rows(aff_y, kept_affs);
+    keep_rows(names.affs, kept_affs);
+    keep_rows(aff_list_pos, kept_affs);
+    keep_rows(pub_ids, kept_pubs);
+    keep_rows(pub_years, kept_pubs);
+    keep_rows(pub_parents, kept_pubs);
+    for ( auto& parent : pub_parents ) { parent = new_slot_of(parent); }
+    keep_rows(names.pubs, kept_pubs);
+    keep_rows(pub_ref_pos, kept_pubs);
+    keep_rows(pub_list_pos, kept_pubs);
+    reset_container(free_handles);
+    reset_container(free_slots);
+    for ( auto& id : aff_ids ) { id.shrink_to_fit(); }
+    for ( auto& id : affIDList ) { id.shrink_to_fit(); }
+    affIDList.shrink_to_fit();
+    //Only the live IDs are left, all at their own length
+    long_ids.seen = std::any_of(aff_ids.begin(), aff_ids.end(), [](AffiliationID const& id) { return id.size() > SHORT_ID_LENGTH; });
+    pubIDList.shrink_to_fit();
+
+    //Name pool with the live names only
+    std::string pool;
+    std::size_t live_bytes = 0;
+    for ( auto const& ref : names.affs ) { live_bytes += ref.length; }
+    for ( auto const& ref : names.pubs ) { live_bytes += ref.length; }
+    pool.reserve(live_bytes);
+    auto move_name = [&](NameRef& ref)
+    {
+        auto name = name_of(ref);
+        ref.offset = pool.size();
+        pool += name;
+    };
+    for ( auto& ref : names.affs ) { move_name(ref); }
+    for ( auto& ref : names.pubs ) { move_name(ref); }
+    names.pool.swap(pool);
+
+    //Lists, each one only as long as it is (inline if it fits)
+    aff_pubs.shrink_to_fit(kept_affs, new_slot_of);
+    aff_pub_pos.shrink_to_fit(kept_affs, [](unsigned int pos) { return pos; });
+    aff_years.shrink_to_fit(kept_affs, [&](std::pair<Year, PubSlot> const& e)
+    {
+        return std::make_pair(e.first, new_slot_of(e.second));
+    });
+    aff_links.shrink_to_fit(kept_affs, [&](std::pair<AffHandle, Weight> const& link)
+    {
+        return std::make_pair(new_handle_of(link.first), link.second);
+    });
+    pub_affs.shrink_to_fit(kept_pubs, new_handle_of);
+    pub_aff_pos.shrink_to_fit(kept_pubs, [](unsigned int pos) { return pos; });
+    pub_refs.shrink_to_fit(kept_pubs, new_slot_of);
+
+    //Flat tables
+    for ( auto& p : publications_map ) { p.second = new_slot_of(p.second); }
+    publications_map.shrink_to_fit();
+    for ( auto& c : coord_to_id_map ) { c.second = new_handle_of(c.second); }
+    coord_to_id_map.shrink_to_fit();
+    FlatHashMap<unsigned long long, unsigned int> positions;
+    positions.reserve(link_pos.size());
+    for ( auto const& l : link_pos ) {
+        positions.insert({link_key(new_handle_of(l.first >> 32), new_handle_of(l.first & 0xffffffffULL)), l.second});
+    }
+    positions.shrink_to_fit();
+    link_pos = std::move(positions);
+
+    //Node containers back into the fresh arena
+    aff_handles.reserve(handles.size());
+    for ( auto& a : handles ) { aff_handles.emplace(std::move(a.first), a.second); }
+    for ( auto h : by_name ) { names.affs_by_name.emplace_hint(names.affs_by_name.end(), h); }
+    for ( auto& a : by_distance ) { affs_by_distance.emplace_hint(affs_by_distance.end(), a); }
+    for ( auto s : pubs_named ) { names.pubs_by_name.emplace_hint(names.pubs_by_name.end(), s); }
+
+    //Tables by slot rebuilt at the new size
+    reset_container(lift);
+    reset_container(pub_depth);
+    reset_container(dfs_order);
+    reset_container(pre_order);
+    reset_container(subtree_end);
+    ancestors_valid = false;
+    intervals_valid = false;
+    ancestors_update();
+    intervals_update();
+
+    //The year tree covers every possible year, it can only go when there are no publications
+    if ( pub_ids.empty() ) { reset_container(year_tree); }
+
+    //Indexes rebuilt from scratch
+    pub_trigrams_rebuild();
+    for ( auto& postings : pub_trigrams ) { postings.second.shrink_to_fit(); }
+    pub_trigrams.rehash(0);
+    grid_rebuild();
+}
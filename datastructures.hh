@@ -8,6 +8,10 @@
 #define DATASTRUCTURES_HH
 
 #include <string>
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <tuple>
 #include <utility>
@@ -15,6 +19,18 @@
 #include <functional>
 #include <exception>
 #include <map>
+#include <set>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#ifdef DATASTRUCTURES_STATS
+#include <atomic>
+#include <array>
+#endif
+#include <unordered_map>
 #include <unordered_set>
 
 // Types for IDs
@@ -72,9 +88,700 @@ inline bool operator<(Coord c1, Coord c2)
 // Return value for cases where coordinates were not found
 Coord const NO_COORD = {NO_VALUE, NO_VALUE};
 
+// Pseudo-random numbers, also used by the tests and benchmarks to generate data
+extern std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
+
+template <typename Type>
+Type random_in_range(Type start, Type end)
+{
+    auto range = end-start;
+    ++range;
+
+    auto num = std::uniform_int_distribution<unsigned long int>(0, range-1)(rand_engine);
+
+    return static_cast<Type>(start+num);
+}
+
+// Records for the batch operations, same fields as the single add operations
+struct AffiliationRecord
+{
+    AffiliationID id;
+    Name name;
+    Coord xy;
+};
+
+struct PublicationRecord
+{
+    PublicationID id;
+    Name name;
+    Year year;
+    std::vector<AffiliationID> affiliations;
+};
+
+// (id, parentid) as given to add_reference
+using ReferenceRecord = std::pair<PublicationID, PublicationID>;
+
+// Result of load_text
+struct LoadStats
+{
+    bool opened = false;
+    std::size_t bytes = 0;
+    std::size_t lines = 0;
+    std::size_t bad_lines = 0;     // lines that couldn't be parsed
+    std::size_t affiliations = 0;  // records actually added
+    std::size_t publications = 0;
+    std::size_t references = 0;
+    std::size_t unresolved = 0;    // records dropped because an ID they refer to is nowhere
+    double seconds = 0;
+
+    std::size_t records() const { return affiliations + publications + references; }
+    double mb_per_second() const { return seconds > 0 ? bytes / 1e6 / seconds : 0; }
+    double records_per_second() const { return seconds > 0 ? records() / seconds : 0; }
+};
+
+// Result of memory_usage, bytes held by each part of Datastructures.
+// Capacity is counted, not size, and node based containers are estimated
+// from their element count.
+struct MemoryUsage
+{
+    std::size_t maps = 0;       // ID and coordinate hash maps, connection positions
+    std::size_t id_lists = 0;   // ID columns, affIDList/pubIDList, free handles and slots
+    std::size_t columns = 0;    // coordinates, years, parents, name references, positions
+    std::size_t adjacency = 0;  // publication, reference, year and connection lists
+    std::size_t strings = 0;    // name pool and heap parts of AffiliationID/Name strings
+    std::size_t indexes = 0;    // ordered sets, grid, trigrams, year tree, ancestor and DFS tables
+
+    std::size_t total() const { return maps + id_lists + columns + adjacency + strings + indexes; }
+};
+
+// Read-only view straight into a vector owned by Datastructures, nothing is copied.
+template <typename T>
+class ListView
+{
+public:
+    using value_type = T;
+    using iterator = T const*;
+
+    ListView() = default;
+    ListView(T const* first, T const* last) : first_{first}, last_{last} {}
+
+    iterator begin() const { return first_; }
+    iterator end() const { return last_; }
+    std::size_t size() const { return last_ - first_; }
+    bool empty() const { return first_ == last_; }
+    T const& operator[](std::size_t i) const { return first_[i]; }
+
+private:
+    T const* first_ = nullptr;
+    T const* last_ = nullptr;
+};
+
+// Many short lists stored in two flat arrays instead of one heap allocation
+// per list. A list of up to N elements lives inline in its header, a longer
+// one in storage_, where it is moved to the end with double the capacity
+// when it grows. Space left behind is reused by compacting storage_ once it
+// is mostly garbage. Elements must be trivially destructible so that
+// clear() is O(1).
+// pool[i] gives a small vector-like handle to list i. Pointers into a list
+// are invalidated by any change to the pool that can grow a list.
+template <typename T, unsigned int N>
+class ListPool
+{
+    static_assert(std::is_trivially_destructible<T>::value, "ListPool elements are never destroyed");
+
+    struct Header
+    {
+        unsigned int size = 0;
+        unsigned int capacity = N;
+        std::size_t offset = 0;
+        T inline_items[N] = {};
+    };
+
+public:
+    class List
+    {
+    public:
+        List(ListPool* pool, std::size_t index) : pool_{pool}, index_{index} {}
+
+        T* data() const { return pool_->items(index_); }
+        T* begin() const { return data(); }
+        T* end() const { return data() + size(); }
+        std::reverse_iterator<T*> rbegin() const { return std::reverse_iterator<T*>(end()); }
+        std::reverse_iterator<T*> rend() const { return std::reverse_iterator<T*>(begin()); }
+        std::size_t size() const { return pool_->headers_[index_].size; }
+        bool empty() const { return size() == 0; }
+        T& operator[](std::size_t i) const { return data()[i]; }
+        T& back() const { return data()[size() - 1]; }
+
+        void reserve(std::size_t n) const { pool_->reserve(index_, n); }
+        void push_back(T const& value) const
+        {
+            pool_->reserve(index_, size() + 1);
+            data()[pool_->headers_[index_].size++] = value;
+        }
+        void pop_back() const { --pool_->headers_[index_].size; }
+        void clear() const { pool_->headers_[index_].size = 0; }
+
+        T* insert(T* pos, T const& value) const
+        {
+            std::size_t i = pos - data();
+            push_back(value);
+            std::rotate(data() + i, end() - 1, end());
+            return data() + i;
+        }
+
+        T* erase(T* first, T* last) const
+        {
+            T* new_end = std::move(last, end(), first);
+            pool_->headers_[index_].size = new_end - data();
+            return first;
+        }
+
+    private:
+        ListPool* pool_;
+        std::size_t index_;
+    };
+
+    class ConstList
+    {
+    public:
+        ConstList(ListPool const* pool, std::size_t index) : pool_{pool}, index_{index} {}
+
+        T const* data() const { return pool_->items(index_); }
+        T const* begin() const { return data(); }
+        T const* end() const { return data() + size(); }
+        std::reverse_iterator<T const*> rbegin() const { return std::reverse_iterator<T const*>(end()); }
+        std::reverse_iterator<T const*> rend() const { return std::reverse_iterator<T const*>(begin()); }
+        std::size_t size() const { return pool_->headers_[index_].size; }
+        bool empty() const { return size() == 0; }
+        T const& operator[](std::size_t i) const { return data()[i]; }
+        T const& back() const { return data()[size() - 1]; }
+
+    private:
+        ListPool const* pool_;
+        std::size_t index_;
+    };
+
+    List operator[](std::size_t i) { return {this, i}; }
+    ConstList operator[](std::size_t i) const { return {this, i}; }
+
+    // Number of lists
+    std::size_t size() const { return headers_.size(); }
+    bool empty() const { return headers_.empty(); }
+
+    void emplace_back() { headers_.emplace_back(); }
+    void resize(std::size_t count) { headers_.resize(count); }
+    void reserve_lists(std::size_t count) { headers_.reserve(count); }
+
+    // Empties list i and gives its out of line space back
+    void release(std::size_t i)
+    {
+        Header& h = headers_[i];
+        if ( h.capacity > N ) { garbage_ += h.capacity; }
+        h = Header();
+    }
+
+    // Removes all lists, O(1) since nothing is destroyed one by one
+    void clear()
+    {
+        headers_.clear();
+        storage_.clear();
+        garbage_ = 0;
+    }
+
+    // Elements held in storage_ and how many of them are unused
+    std::size_t storage_size() const { return storage_.size(); }
+    std::size_t garbage_size() const { return garbage_; }
+
+    // Bytes allocated for the headers and the storage
+    std::size_t memory_bytes() const { return headers_.capacity() * sizeof(Header) + storage_.capacity() * sizeof(T); }
+
+    // Packs the lists tightly: every list gets capacity max(size, N), so
+    // lists that fit go back inline, and headers and storage are exactly sized.
+    void shrink_to_fit()
+    {
+        std::vector<unsigned int> kept(headers_.size());
+        std::iota(kept.begin(), kept.end(), 0);
+        shrink_to_fit(kept, [](T const& item) { return item; });
+    }
+
+    // Same, keeping only lists kept[0], kept[1]... which become lists 0, 1...
+    // Every element is replaced by map(element), for renumbering handles.
+    template <typename Map>
+    void shrink_to_fit(std::vector<unsigned int> const& kept, Map map)
+    {
+        std::size_t out_of_line = 0;
+        for ( auto i : kept ) {
+            if ( headers_[i].size > N ) { out_of_line += headers_[i].size; }
+        }
+        std::vector<Header> headers;
+        headers.reserve(kept.size());
+        std::vector<T> storage;
+        storage.reserve(out_of_line);
+        for ( auto i : kept ) {
+            T const* old_items = items(i);
+            Header h;
+            h.size = headers_[i].size;
+            T* new_items = h.inline_items;
+            if ( h.size > N ) {
+                h.capacity = h.size;
+                h.offset = storage.size();
+                storage.resize(storage.size() + h.size);
+                new_items = storage.data() + h.offset;
+            }
+            std::transform(old_items, old_items + h.size, new_items, map);
+            headers.push_back(h);
+        }
+        headers_.swap(headers);
+        storage_.swap(storage);
+        garbage_ = 0;
+    }
+
+    // Replaces the lists by count lists in CSR form, list i is
+    // values[offsets[i] .. offsets[i + 1]). Packed like shrink_to_fit.
+    template <typename Offset>
+    void assign(Offset const* offsets, T const* values, std::size_t count)
+    {
+        std::size_t out_of_line = 0;
+        for ( std::size_t i = 0; i < count; ++i ) {
+            if ( offsets[i + 1] - offsets[i] > N ) { out_of_line += offsets[i + 1] - offsets[i]; }
+        }
+        std::vector<Header> headers(count);
+        std::vector<T> storage;
+        storage.reserve(out_of_line);
+        for ( std::size_t i = 0; i < count; ++i ) {
+            Header& h = headers[i];
+            h.size = offsets[i + 1] - offsets[i];
+            if ( h.size > N ) {
+                h.capacity = h.size;
+                h.offset = storage.size();
+                storage.insert(storage.end(), values + offsets[i], values + offsets[i + 1]);
+            }
+            else {
+                std::copy(values + offsets[i], values + offsets[i + 1], h.inline_items);
+            }
+        }
+        headers_.swap(headers);
+        storage_.swap(storage);
+        garbage_ = 0;
+    }
+
+    // Moves every out of line list next to each other, dropping the garbage
+    void compact()
+    {
+        std::vector<T> packed;
+        packed.reserve(storage_.size() - garbage_);
+        for ( auto& h : headers_ ) {
+            if ( h.capacity <= N ) { continue; }
+            std::size_t offset = packed.size();
+            packed.insert(packed.end(), storage_.begin() + h.offset, storage_.begin() + h.offset + h.capacity);
+            h.offset = offset;
+        }
+        storage_ = std::move(packed);
+        garbage_ = 0;
+    }
+
+private:
+    T* items(std::size_t i)
+    {
+        Header& h = headers_[i];
+        return h.capacity <= N ? h.inline_items : storage_.data() + h.offset;
+    }
+
+    T const* items(std::size_t i) const
+    {
+        Header const& h = headers_[i];
+        return h.capacity <= N ? h.inline_items : storage_.data() + h.offset;
+    }
+
+    void reserve(std::size_t i, std::size_t n)
+    {
+        if ( n <= headers_[i].capacity ) { return; }
+
+        if ( garbage_ > storage_.size() / 2 ) { compact(); }
+
+        Header& h = headers_[i];
+        std::size_t capacity = std::max<std::size_t>(n, 2 * h.capacity);
+        std::size_t offset = storage_.size();
+        storage_.resize(offset + capacity);
+        T* old_items = items(i);
+        std::copy(old_items, old_items + h.size, storage_.data() + offset);
+        if ( h.capacity > N ) { garbage_ += h.capacity; }
+        h.offset = offset;
+        h.capacity = capacity;
+    }
+
+    std::vector<Header> headers_;
+    std::vector<T> storage_;
+    std::size_t garbage_ = 0;
+};
+
+// Hash for the flat maps: the splitmix64 finalizer, every input bit affects
+// every output bit, which linear probing needs much more than the node maps.
+struct MixHash
+{
+    static std::uint64_t mix(std::uint64_t v)
+    {
+        v ^= v >> 30;
+        v *= 0xbf58476d1ce4e5b9ULL;
+        v ^= v >> 27;
+        v *= 0x94d049bb133111ebULL;
+        return v ^ (v >> 31);
+    }
+
+    std::size_t operator()(unsigned long long v) const { return mix(v); }
+    std::size_t operator()(Coord xy) const
+    {
+        return mix((static_cast<std::uint64_t>(static_cast<std::uint32_t>(xy.x)) << 32) | static_cast<std::uint32_t>(xy.y));
+    }
+};
+
+// Open addressing hash map with linear probing. Entries are stored in one
+// array (no allocation per insert), a lookup is usually a single cache miss.
+// Erasing shifts the following entries of the probe run back, so there are
+// no tombstones. The table doubles when 3/4 full.
+// Only the parts of std::unordered_map used here are provided. Any insert
+// or erase invalidates iterators.
+template <typename Key, typename Value, typename Hash = MixHash>
+class FlatHashMap
+{
+public:
+    using value_type = std::pair<Key, Value>;
+
+    template <typename Map, typename Entry>
+    class basic_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Entry*;
+        using reference = Entry&;
+
+        basic_iterator() = default;
+        basic_iterator(Map* map, std::size_t i) : map_{map}, i_{i} { skip(); }
+
+        reference operator*() const { return map_->entries_[i_]; }
+        pointer operator->() const { return &map_->entries_[i_]; }
+        basic_iterator& operator++() { ++i_; skip(); return *this; }
+        bool operator==(basic_iterator const& other) const { return i_ == other.i_; }
+        bool operator!=(basic_iterator const& other) const { return i_ != other.i_; }
+
+    private:
+        friend class FlatHashMap;
+        void skip() { while ( i_ < map_->used_.size() && !map_->used_[i_] ) { ++i_; } }
+
+        Map* map_ = nullptr;
+        std::size_t i_ = 0;
+    };
+    using iterator = basic_iterator<FlatHashMap, value_type>;
+    using const_iterator = basic_iterator<FlatHashMap const, value_type const>;
+
+    iterator begin() { return {this, 0}; }
+    iterator end() { return {this, used_.size()}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, used_.size()}; }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    double load_factor() const { return used_.empty() ? 0.0 : static_cast<double>(size_) / used_.size(); }
+
+    // Makes room for count entries without rehashing
+    void reserve(std::size_t count)
+    {
+        std::size_t capacity = 16;
+        while ( capacity / 4 * 3 < count ) { capacity *= 2; }
+        if ( capacity > used_.size() ) { rehash(capacity); }
+    }
+
+    // Bytes allocated for the table
+    std::size_t memory_bytes() const { return entries_.capacity() * sizeof(value_type) + used_.capacity(); }
+
+    // Rehashes to the smallest table that holds the current entries
+    void shrink_to_fit()
+    {
+        std::size_t capacity = 16;
+        while ( capacity / 4 * 3 < size_ ) { capacity *= 2; }
+        if ( size_ == 0 ) { clear(); }
+        else if ( capacity < used_.size() ) { rehash(capacity); }
+    }
+
+    // Drops the entries and the table
+    void clear()
+    {
+        std::vector<value_type>().swap(entries_);
+        std::vector<unsigned char>().swap(used_);
+        size_ = 0;
+    }
+
+    iterator find(Key const& key) { return {this, find_index(key)}; }
+    const_iterator find(Key const& key) const { return {this, find_index(key)}; }
+
+    std::pair<iterator, bool> insert(value_type const& entry)
+    {
+        std::size_t i = find_index(entry.first);
+        if ( i != used_.size() ) { return {iterator(this, i), false}; }
+        i = place(entry.first);
+        entries_[i] = entry;
+        return {iterator(this, i), true};
+    }
+
+    Value& operator[](Key const& key)
+    {
+        std::size_t i = find_index(key);
+        if ( i == used_.size() ) {
+            i = place(key);
+            entries_[i] = {key, Value()};
+        }
+        return entries_[i].second;
+    }
+
+    void erase(iterator it) { erase_index(it.i_); }
+
+    std::size_t erase(Key const& key)
+    {
+        std::size_t i = find_index(key);
+        if ( i == used_.size() ) { return 0; }
+        erase_index(i);
+        return 1;
+    }
+
+private:
+    std::size_t mask() const { return used_.size() - 1; }
+    std::size_t home(Key const& key) const { return Hash()(key) & mask(); }
+
+    // Index of key, used_.size() if not found
+    std::size_t find_index(Key const& key) const
+    {
+        if ( size_ == 0 ) { return used_.size(); }
+        for ( std::size_t i = home(key); used_[i]; i = (i + 1) & mask() ) {
+            if ( entries_[i].first == key ) { return i; }
+        }
+        return used_.size();
+    }
+
+    // Marks the first free index of key's probe run used, key must be new
+    std::size_t place(Key const& key)
+    {
+        if ( (size_ + 1) > used_.size() / 4 * 3 ) { rehash(used_.empty() ? 16 : used_.size() * 2); }
+        std::size_t i = home(key);
+        while ( used_[i] ) { i = (i + 1) & mask(); }
+        used_[i] = 1;
+        ++size_;
+        return i;
+    }
+
+    void erase_index(std::size_t i)
+    {
+        //Move back every later entry of the run that may sit at i,
+        //i.e. whose home is not cyclically in (i, j]
+        std::size_t j = i;
+        while ( true ) {
+            j = (j + 1) & mask();
+            if ( !used_[j] ) { break; }
+            std::size_t h = home(entries_[j].first);
+            bool stays = i <= j ? (i < h && h <= j) : (i < h || h <= j);
+            if ( stays ) { continue; }
+            entries_[i] = std::move(entries_[j]);
+            i = j;
+        }
+        used_[i] = 0;
+        entries_[i] = value_type();
+        --size_;
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        std::vector<value_type> old_entries(capacity);
+        std::vector<unsigned char> old_used(capacity, 0);
+        old_entries.swap(entries_);
+        old_used.swap(used_);
+        for ( std::size_t i = 0; i < old_used.size(); ++i ) {
+            if ( !old_used[i] ) { continue; }
+            std::size_t j = home(old_entries[i].first);
+            while ( used_[j] ) { j = (j + 1) & mask(); }
+            used_[j] = 1;
+            entries_[j] = std::move(old_entries[i]);
+        }
+    }
+
+    std::vector<value_type> entries_;
+    std::vector<unsigned char> used_;
+    std::size_t size_ = 0;
+};
+
+// Read-only view over a list of internal handles, each handle is turned into
+// its ID through the table (indexed by handle) when dereferenced. A default constructed view means
+// that the ID asked for was not found.
+template <typename Handle, typename T>
+class MappedListView
+{
+public:
+    using value_type = T;
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        iterator() = default;
+        iterator(Handle const* pos, T const* table) : pos_{pos}, table_{table} {}
+
+        T const& operator*() const { return table_[*pos_]; }
+        T const* operator->() const { return &**this; }
+        T const& operator[](difference_type n) const { return table_[pos_[n]]; }
+        iterator& operator++() { ++pos_; return *this; }
+        iterator operator++(int) { auto old = *this; ++pos_; return old; }
+        iterator& operator--() { --pos_; return *this; }
+        iterator operator--(int) { auto old = *this; --pos_; return old; }
+        iterator& operator+=(difference_type n) { pos_ += n; return *this; }
+        iterator& operator-=(difference_type n) { pos_ -= n; return *this; }
+        iterator operator+(difference_type n) const { return {pos_ + n, table_}; }
+        iterator operator-(difference_type n) const { return {pos_ - n, table_}; }
+        difference_type operator-(iterator const& other) const { return pos_ - other.pos_; }
+        bool operator==(iterator const& other) const { return pos_ == other.pos_; }
+        bool operator!=(iterator const& other) const { return pos_ != other.pos_; }
+        bool operator<(iterator const& other) const { return pos_ < other.pos_; }
+
+    private:
+        Handle const* pos_ = nullptr;
+        T const* table_ = nullptr;
+    };
+
+    MappedListView() = default;
+    //table holds every handle in handles, so it isn't empty
+    template <typename Handles, typename Table>
+    MappedListView(Handles const& handles, Table const& table)
+        : first_{handles.data()}, last_{handles.data() + handles.size()}, table_{table.data()} {}
+
+    iterator begin() const { return {first_, table_}; }
+    iterator end() const { return {last_, table_}; }
+    std::size_t size() const { return last_ - first_; }
+    bool empty() const { return first_ == last_; }
+    T const& operator[](std::size_t i) const { return table_[first_[i]]; }
+    bool found() const { return table_ != nullptr; }
+
+private:
+    Handle const* first_ = nullptr;
+    Handle const* last_ = nullptr;
+    T const* table_ = nullptr;
+};
+
 // Return value for cases where Distance is unknown
 Distance const NO_DISTANCE = NO_VALUE;
 
+// Connection in the collaboration graph: aff1 and aff2 have weight publications in common
+struct Connection
+{
+    AffiliationID aff1 = NO_AFFILIATION;
+    AffiliationID aff2 = NO_AFFILIATION;
+    Weight weight = NO_WEIGHT;
+
+    bool operator==(Connection const& other) const
+    {
+        return aff1 == other.aff1 && aff2 == other.aff2 && weight == other.weight;
+    }
+};
+
+// Return value for cases where a Connection is not found
+Connection const NO_CONNECTION{NO_AFFILIATION, NO_AFFILIATION, NO_WEIGHT};
+
+// Path from one affiliation to another, aff2 of each connection is aff1 of the next
+using Path = std::vector<Connection>;
+
+// Path with the length of every connection
+using PathWithDist = std::vector<std::pair<Connection, Distance>>;
+
+// Citation figures of one publication. direct_citations is the number of
+// its direct references (get_direct_references), transitive_citations the
+// length of its referenced-by chain. score is PageRank over the references.
+struct PublicationInfluence
+{
+    PublicationID id = NO_PUBLICATION;
+    unsigned int direct_citations = 0;
+    unsigned int transitive_citations = 0;
+    double score = 0;
+};
+
+#ifdef DATASTRUCTURES_STATS
+// Instrumentation, only compiled in when DATASTRUCTURES_STATS is defined.
+// Counters are relaxed atomics so that const queries (and snapshot readers
+// on several threads) can record without locking. A public operation that
+// calls other public operations is recorded once, under its own name.
+
+// Operations that are timed
+#define DATASTRUCTURES_TIMED_OPERATIONS(X) \
+    X(clear_all) X(get_all_affiliations) X(add_affiliation) X(get_affiliation_name) \
+    X(get_affiliation_coord) X(get_affiliations_alphabetically) X(get_affiliations_distance_increasing) \
+    X(get_affiliations_distance_increasing_from) \
+    X(find_affiliation_with_coord) X(change_affiliation_coord) X(add_publication) X(all_publications) \
+    X(get_publication_name) X(get_publication_year) X(get_affiliations) X(add_reference) \
+    X(get_direct_references) X(add_affiliation_to_publication) X(get_publications) X(get_parent) \
+    X(get_publications_after) X(get_publications_between) X(get_referenced_by_chain) X(get_all_references) \
+    X(get_affiliations_nearest) X(get_affiliations_within_radius) X(get_affiliations_in_rectangle) \
+    X(remove_affiliation) X(get_closest_common_parent) X(get_kth_parent) X(is_ancestor) \
+    X(get_all_references_count) X(remove_publication) X(add_affiliations) X(add_publications) \
+    X(add_references) X(publish_snapshot) X(save_snapshot) X(load_snapshot) X(load_text) \
+    X(find_affiliations_by_prefix) X(find_affiliations_by_name) X(find_publications_by_name) \
+    X(find_publications_by_substring) X(get_connected_affiliations) X(get_all_connections) \
+    X(get_any_path) X(get_path_with_least_affiliations) X(get_path_of_least_friction) X(get_shortest_path) \
+    X(get_publication_count_between) X(get_total_publication_count_between) X(get_top_affiliations_between) \
+    X(get_top_publications_by_influence) X(compact) X(get_affiliation_count) X(snapshot) \
+    X(get_affiliations_alphabetically_paged) X(get_affiliations_distance_increasing_paged) \
+    X(view_all_affiliations) X(view_all_publications) X(view_affiliations) X(view_direct_references) \
+    X(view_publications) X(get_all_references_range) X(get_affiliations_closest_to) X(remove_publications) \
+    X(stats_text) X(stats_json) X(reset_stats) X(memory_usage)
+
+// Hits and misses of the lazily rebuilt lists and tables, and how often they are invalidated,
+// and how many published snapshots were brought up to date or copied
+#define DATASTRUCTURES_COUNTERS(X) \
+    X(affIDList_hits) X(affIDList_rebuilds) X(affIDList_invalidations) \
+    X(pubIDList_hits) X(pubIDList_rebuilds) X(pubIDList_invalidations) \
+    X(ancestors_hits) X(ancestors_rebuilds) X(ancestors_invalidations) \
+    X(intervals_hits) X(intervals_rebuilds) X(intervals_invalidations) \
+    X(grid_rebuilds) X(snapshot_replays) X(snapshot_copies)
+
+class DatastructuresStats
+{
+public:
+#define DATASTRUCTURES_ENUM_ENTRY(name) name,
+    enum Operation { DATASTRUCTURES_TIMED_OPERATIONS(DATASTRUCTURES_ENUM_ENTRY) OPERATION_COUNT };
+    enum Counter { DATASTRUCTURES_COUNTERS(DATASTRUCTURES_ENUM_ENTRY) COUNTER_COUNT };
+#undef DATASTRUCTURES_ENUM_ENTRY
+
+    // Latency histogram bucket i counts calls that took [2^i, 2^(i+1)) ns
+    static constexpr std::size_t BUCKETS = 40;
+
+    struct OperationData
+    {
+        std::atomic<unsigned long long> calls{0};
+        std::atomic<unsigned long long> total_ns{0};
+        std::array<std::atomic<unsigned long long>, BUCKETS> buckets{};
+    };
+
+    DatastructuresStats() = default;
+
+    void record(Operation op, unsigned long long ns) const;
+    void count(Counter c) const { counters_[c].fetch_add(1, std::memory_order_relaxed); }
+    void reset();
+
+    static char const* name(Operation op);
+    static char const* name(Counter c);
+    OperationData const& operation(Operation op) const { return operations_[op]; }
+    unsigned long long counter(Counter c) const { return counters_[c].load(std::memory_order_relaxed); }
+
+private:
+    mutable std::array<OperationData, OPERATION_COUNT> operations_;
+    mutable std::array<std::atomic<unsigned long long>, COUNTER_COUNT> counters_{};
+};
+#endif
+
+class Snapshot;
+
 // This exception class is there just so that the user interface can notify
 // about operations which are not (yet) implemented
 class NotImplemented : public std::exception
@@ -99,153 +806,813 @@ public:
     Datastructures();
     ~Datastructures();
 
+    Datastructures(Datastructures const&) = default;
+    Datastructures& operator=(Datastructures const&) = default;
+    Datastructures& operator=(Datastructures&&) = default;
+
     // Estimate of performance: O(1)
-    // Short rationale for estimate: getting a vector's size is constant time operation
-    unsigned int get_affiliation_count();
+    // Short rationale for estimate: getting a map's size is constant time operation
+    unsigned int get_affiliation_count() const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: only linear operations
+    // Estimate of performance: O(1) plus giving the memory back (the arena's chunks and
+    // the flat tables' arrays), O(n) if an AffiliationID too long for std::string's
+    // own buffer (15 characters with libstdc++) has been added since the last
+    // clear_all or compact
+    // Short rationale for estimate: the containers in the arena are dropped without
+    // visiting their elements, everything else holds plain values
     void clear_all();
 
     // Estimate of performance: O(n)
     // Short rationale for estimate: returning vec involves copying all values -> O(n)
     std::vector<AffiliationID> get_all_affiliations();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find + insert = O(n+m)
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: map.find() O(1) + inserting to the ordered indexes O(logn)
     bool add_affiliation(AffiliationID id, Name const& name, Coord xy);
 
+    // Estimate of performance: O(1) on average, O(n) worst case
+    // Short rationale for estimate: one unordered_map.find(), worst case if hash collisions
+    Name get_affiliation_name(AffiliationID id) const;
+
+    // Estimate of performance: O(1) on average, O(n) worst case
+    // Short rationale for estimate: one unordered_map.find(), worst case if hash collisions
+    Coord get_affiliation_coord(AffiliationID id) const;
+
+
+    // We recommend you implement the operations below only after implementing the ones above
+
     // Estimate of performance: O(n)
-    // Short rationale for estimate: worst case if hash collisions
-    Name get_affiliation_name(AffiliationID id);
+    // Short rationale for estimate: affs_by_name is kept sorted, only copying the output
+    std::vector<AffiliationID> get_affiliations_alphabetically() const;
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: worst case if hash collisions
-    Coord get_affiliation_coord(AffiliationID id);
+    // Short rationale for estimate: affs_by_distance is kept sorted, only copying the output
+    std::vector<AffiliationID> get_affiliations_distance_increasing() const;
 
+    // Paged versions of the two above: count affiliations starting from position offset.
 
-    // We recommend you implement the operations below only after implementing the ones above
+    // Estimate of performance: O(offset + count)
+    // Short rationale for estimate: walking the ordered index, no sorting
+    std::vector<AffiliationID> get_affiliations_alphabetically(unsigned int offset, unsigned int count) const;
 
-    // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: std::sort is O(nlogn)
-    std::vector<AffiliationID> get_affiliations_alphabetically();
+    // Estimate of performance: O(offset + count)
+    // Short rationale for estimate: walking the ordered index, no sorting
+    std::vector<AffiliationID> get_affiliations_distance_increasing(unsigned int offset, unsigned int count) const;
 
+    // Like get_affiliations_distance_increasing, but distances are measured from xy
     // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: std::sort is O(nlogn)
-    std::vector<AffiliationID> get_affiliations_distance_increasing();
+    // Short rationale for estimate: one vectorized pass computes all distances, then a parallel sort
+    std::vector<AffiliationID> get_affiliations_distance_increasing_from(Coord xy) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: might have to go through map n times
-    AffiliationID find_affiliation_with_coord(Coord xy);
+    // Estimate of performance: O(1) on average, O(n) worst case
+    // Short rationale for estimate: coord_to_id_map.find(), worst case if hash collisions
+    AffiliationID find_affiliation_with_coord(Coord xy) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: might have to go through map n times
+    // Estimate of performance: O(logn)
+    // Short rationale for estimate: erase + insert in affs_by_distance O(logn), grid cell and coord_to_id_map O(1) on average
     bool change_affiliation_coord(AffiliationID id, Coord newcoord);
 
 
     // We recommend you implement the operations below only after implementing the ones above
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: O(n+m) because of for loop and std::find
+    // Estimate of performance: O(m*(p + mlogm)), m = number of affiliations given, p = their publications
+    // Short rationale for estimate: one map.find() per affiliation + sorted insert to its year index + connection weights
     bool add_publication(PublicationID id, Name const& name, Year year, const std::vector<AffiliationID> & affiliations);
 
     // Estimate of performance: O(n)
-    // Short rationale for estimate: getting a vector's size is constant time operation
+    // Short rationale for estimate: returning vec involves copying all values -> O(n)
     std::vector<PublicationID> all_publications();
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Iterating through pubIDList
-    Name get_publication_name(PublicationID id);
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: publications_map.find() is usually one probe
+    Name get_publication_name(PublicationID id) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: Iterating through pubIDList
-    Year get_publication_year(PublicationID id);
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: publications_map.find() is usually one probe
+    Year get_publication_year(PublicationID id) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find is O(n)
-    std::vector<AffiliationID> get_affiliations(PublicationID id);
+    // Estimate of performance: O(m), m = affiliations of the publication
+    // Short rationale for estimate: copy of view_affiliations
+    std::vector<AffiliationID> get_affiliations(PublicationID id) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find is O(n)
+    // Estimate of performance: O(logn), O(d) while the ancestor tables are out of date, d = depth
+    // Short rationale for estimate: map.find() x 2 + cycle check + updating one row of the ancestor tables
     bool add_reference(PublicationID id, PublicationID parentid);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find is O(n)
-    std::vector<PublicationID> get_direct_references(PublicationID id);
+    // Estimate of performance: O(m), m = direct references
+    // Short rationale for estimate: copy of view_direct_references
+    std::vector<PublicationID> get_direct_references(PublicationID id) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find x 2 O(n) + map.at() (O(1)) = O(n)
+    // Estimate of performance: O(p + mlogm), p = publications of the affiliation, m = affiliations of the publication
+    // Short rationale for estimate: map.find() x 2, both usually constant + sorted insert to the year index + m connection weights
     bool add_affiliation_to_publication(AffiliationID affiliationid, PublicationID publicationid);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: std::find is O(n)
-    std::vector<PublicationID> get_publications(AffiliationID id);
+    // Estimate of performance: O(m), m = publications of the affiliation
+    // Short rationale for estimate: copy of view_publications
+    std::vector<PublicationID> get_publications(AffiliationID id) const;
 
     // Estimate of performance: O(1)
-    // Short rationale for estimate: map.find() is usually constant for unordered_map
-    PublicationID get_parent(PublicationID id);
+    // Short rationale for estimate: publications_map.find() is usually one probe
+    PublicationID get_parent(PublicationID id) const;
 
-    // Estimate of performance: O(nlogn)
-    // Short rationale for estimate: std::find and for-loop O(n) + std::sort O(nlogn) = O(nlogn)
-    std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID affiliationid, Year year);
+    // Estimate of performance: O(logm + k), m = publications of the affiliation, k = output size
+    // Short rationale for estimate: aff_years is kept sorted, binary search + copying the output
+    std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID affiliationid, Year year) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: recursion/complexity depends on depth of chain
-    std::vector<PublicationID> get_referenced_by_chain(PublicationID id);
+    // Estimate of performance: O(logm + k), m = publications of the affiliation, k = output size
+    // Short rationale for estimate: two binary searches on aff_years + copying the output
+    std::vector<std::pair<Year, PublicationID>> get_publications_between(AffiliationID affiliationid, Year from, Year to) const;
+
+    // Year statistics, years from and to are both included.
+
+    // Estimate of performance: O(logm), m = publications of the affiliation
+    // Short rationale for estimate: same two binary searches on aff_years as above, nothing copied. 0 for unknown IDs
+    unsigned int get_publication_count_between(AffiliationID affiliationid, Year from, Year to) const;
+
+    // Estimate of performance: O(logY), Y = number of possible years
+    // Short rationale for estimate: prefix sums from the Fenwick tree over all years
+    unsigned int get_total_publication_count_between(Year from, Year to) const;
+
+    // k affiliations with the most publications in the years, most first, ties by ID
+    // Estimate of performance: O(nlogm + klogk)
+    // Short rationale for estimate: binary searches on every aff_years, then top k selection
+    std::vector<std::pair<AffiliationID, unsigned int>> get_top_affiliations_between(Year from, Year to, unsigned int k) const;
+
+    // Estimate of performance: O(d), d = depth of id in the reference forest
+    // Short rationale for estimate: one step per parent, output reserved when the depth is known
+    std::vector<PublicationID> get_referenced_by_chain(PublicationID id) const;
 
 
     // Non-compulsory operations
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: might have to go through all the involved vectors
+    // Estimate of performance: O(m), m = number of references found, O(n) if the labels have to be rebuilt
+    // Short rationale for estimate: copy of a dfs_order interval, labels rebuilt after changes to the forest
     std::vector<PublicationID> get_all_references(PublicationID id);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
-    std::vector<AffiliationID> get_affiliations_closest_to(Coord xy);
+    // Estimate of performance: O(1) on average, O(n) worst case
+    // Short rationale for estimate: spatial grid only visits the cells around xy
+    std::vector<AffiliationID> get_affiliations_closest_to(Coord xy) const;
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: might have to go through entire affIDList and all publications
+    // Estimate of performance: O(k) on average, O(n) worst case
+    // Short rationale for estimate: rings of grid cells around xy are searched until k closest are certain
+    std::vector<AffiliationID> get_affiliations_nearest(Coord xy, unsigned int k) const;
+
+    // Estimate of performance: O(mlogm + c) where m = results, c = grid cells in the radius
+    // Short rationale for estimate: only cells overlapping the circle's bounding box are visited, large results are sorted in parallel
+    std::vector<AffiliationID> get_affiliations_within_radius(Coord xy, int radius) const;
+
+    // Estimate of performance: O(mlogm + c) where m = results, c = grid cells in the rectangle
+    // Short rationale for estimate: only cells overlapping the rectangle are visited, large results are sorted in parallel
+    std::vector<AffiliationID> get_affiliations_in_rectangle(Coord corner1, Coord corner2) const;
+
+    // Estimate of performance: O(m*a*loga + logn), m = publications of the affiliation, a = affiliations per publication
+    // Short rationale for estimate: each link removed in O(1) with the position maps, connection weights O(aloga) + ordered indexes O(logn)
     bool remove_affiliation(AffiliationID id);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: O(3n)->O(n), might have to go through std::find once, id1_parents twice
+    // Estimate of performance: O(logn), O(nlogn) if the forest has changed since the last query
+    // Short rationale for estimate: binary lifting, tables are rebuilt lazily when needed
     PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2);
 
-    // Estimate of performance: O(n)
-    // Short rationale for estimate: might have to go through entire pubIDList, all refs, and all affs
+    // Estimate of performance: O(logn), O(nlogn) if the forest has changed since the last query
+    // Short rationale for estimate: binary lifting jumps by powers of two
+    PublicationID get_kth_parent(PublicationID id, unsigned int k);
+
+    // Estimate of performance: O(1), O(n) if the forest has changed since the last query
+    // Short rationale for estimate: comparing DFS interval labels, labels are rebuilt lazily
+    bool is_ancestor(PublicationID ancestorid, PublicationID id);
+
+    // Estimate of performance: O(1), O(n) if the forest has changed since the last query
+    // Short rationale for estimate: size of the DFS interval of id
+    unsigned int get_all_references_count(PublicationID id);
+
+    // Estimate of performance: O(m*(p + mlogm) + r), m = affiliations of the publication, p = their publications, r = references
+    // Short rationale for estimate: links and the parent's reference removed in O(1), year index erase shifts O(p), connection weights, references become roots
     bool remove_publication(PublicationID publicationid);
 
-    //ID vectors
-    std::vector<AffiliationID> affIDList;
+    // Estimate of performance: O(b*(m*p + r)), b = number of IDs given
+    // Short rationale for estimate: remove_publication for each, returns how many were removed
+    unsigned int remove_publications(std::vector<PublicationID> const& publications);
+
+    // Name search. Affiliations come in alphabetical order (like
+    // get_affiliations_alphabetically), publications in increasing ID order.
+
+    // Estimate of performance: O(logn + m), m = affiliations found
+    // Short rationale for estimate: lower_bound in affs_by_name, matches are next to each other
+    std::vector<AffiliationID> find_affiliations_by_prefix(Name const& prefix) const;
+
+    // Estimate of performance: O(logn + m), m = affiliations found
+    // Short rationale for estimate: same as above
+    std::vector<AffiliationID> find_affiliations_by_name(Name const& name) const;
+
+    // Estimate of performance: O(logn + mlogm), m = publications found
+    // Short rationale for estimate: lower_bound in pubs_by_name, matches sorted by ID
+    std::vector<PublicationID> find_publications_by_name(Name const& name) const;
+
+    // Estimate of performance: O(c*l + mlogm), c = candidates, l = substring length, O(n*l) for substrings shorter than 3
+    // Short rationale for estimate: candidates come from the rarest trigram of the substring and are checked one by one
+    std::vector<PublicationID> find_publications_by_substring(Name const& substring) const;
+
+    // Collaboration graph. Two affiliations are connected when they have
+    // publications in common, the weight is the number of those. Connections
+    // are kept up to date by every link and removal. Unknown IDs give
+    // {NO_CONNECTION}, an empty path means there is no path.
+
+    // Estimate of performance: O(dlogd), d = connections of the affiliation
+    // Short rationale for estimate: adjacency list is kept up to date, sorted by aff2 for the output
+    std::vector<Connection> get_connected_affiliations(AffiliationID id) const;
+
+    // Estimate of performance: O(eloge), e = connections
+    // Short rationale for estimate: every connection once with aff1 < aff2, sorted
+    std::vector<Connection> get_all_connections() const;
+
+    // Estimate of performance: O(n + e)
+    // Short rationale for estimate: same breadth-first search as below
+    Path get_any_path(AffiliationID source, AffiliationID target) const;
+
+    // Estimate of performance: O(n + e)
+    // Short rationale for estimate: breadth-first search, stops when target is reached
+    Path get_path_with_least_affiliations(AffiliationID source, AffiliationID target) const;
+
+    // Path whose weakest connection is as strong as possible (least friction),
+    // fewest affiliations among those
+    // Estimate of performance: O((n + e)logn)
+    // Short rationale for estimate: widest path search with a heap, then a breadth-first search over strong enough connections
+    Path get_path_of_least_friction(AffiliationID source, AffiliationID target) const;
+
+    // Shortest path when connections are as long as the distance between the affiliations
+    // Estimate of performance: O((n + e)logn)
+    // Short rationale for estimate: Dijkstra with a binary heap, stops when target is reached
+    PathWithDist get_shortest_path(AffiliationID source, AffiliationID target) const;
+
+    // k most influential publications by PageRank score, highest first, ties by ID.
+    // Every publication passes its score on to its references (damping 0.85),
+    // iterated until the scores settle. Computed on threads threads, 0 = one per core.
+    // Estimate of performance: O(I*(n + e)/T + nlogk), I = iterations, T = threads
+    // Short rationale for estimate: CSR arrays of the forest and the threads are set up once, each iteration is split over the threads
+    std::vector<PublicationInfluence> get_top_publications_by_influence(unsigned int k, unsigned int threads = 0) const;
+
+
+    // Views, same contents as the vector returning versions above without the copy.
+    // Unknown IDs give an empty view with found() == false.
+    // Invalidation: the all_* views are invalidated by adding or removing
+    // affiliations/publications, by compact, the loads and clear_all.
+    // The per-ID views point into storage shared by all lists of the same kind
+    // (ListPool) and into the ID columns, and growing or compacting any list
+    // moves them. So any change to the Datastructures invalidates all per-ID
+    // views, whichever ID it is about: take a new view after every update.
+    // Queries don't invalidate views.
+
+    // Estimate of performance: O(1), O(n) if the list has to be rebuilt after a removal
+    // Short rationale for estimate: points into affIDList
+    ListView<AffiliationID> view_all_affiliations();
+
+    // Estimate of performance: O(1), O(n) if the list has to be rebuilt after a removal
+    // Short rationale for estimate: points into pubIDList
+    ListView<PublicationID> view_all_publications();
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: map.find() O(1), the view points into pub_affs
+    MappedListView<unsigned int, AffiliationID> view_affiliations(PublicationID id) const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: map.find() O(1), the view points into pub_refs
+    MappedListView<unsigned int, PublicationID> view_direct_references(PublicationID id) const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: map.find() O(1), the view points into aff_pubs
+    MappedListView<unsigned int, PublicationID> view_publications(AffiliationID id) const;
+
+    // Lazy preorder walk over the same publications as get_all_references.
+    // Lets the caller stop early. The range must not be used after the
+    // reference forest or the publications have been modified.
+    class ReferenceIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = PublicationID;
+        using difference_type = std::ptrdiff_t;
+        using pointer = PublicationID const*;
+        using reference = PublicationID;
+
+        ReferenceIterator() = default;
+        ReferenceIterator(Datastructures const* ds, unsigned int root);
+
+        PublicationID operator*() const { return ds_->pub_ids[stack_.back()]; }
+        ReferenceIterator& operator++();
+        ReferenceIterator operator++(int);
+        bool operator==(ReferenceIterator const& other) const { return stack_ == other.stack_; }
+        bool operator!=(ReferenceIterator const& other) const { return !(*this == other); }
+
+    private:
+        Datastructures const* ds_ = nullptr;
+        std::vector<unsigned int> stack_;
+    };
+
+    struct ReferenceRange
+    {
+        ReferenceIterator first;
+        ReferenceIterator last;
+        ReferenceIterator begin() const { return first; }
+        ReferenceIterator end() const { return last; }
+    };
+
+    // Estimate of performance: O(1) to create, O(1) amortized per step
+    // Short rationale for estimate: explicit stack, nothing is visited before it's needed
+    ReferenceRange get_all_references_range(PublicationID id) const;
+
+    // Concurrent mode. One writer thread uses the operations above as usual and
+    // calls publish_snapshot() whenever readers should see its changes. Any
+    // number of reader threads take snapshot() and query the returned object,
+    // which is never modified, so readers see a consistent state without
+    // locking and without writing to anything shared. A snapshot stays valid
+    // for as long as the reader holds on to it.
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: atomic load of a shared_ptr
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    // The snapshot published before the current one is reused once no reader
+    // holds it any more: the updates made since it was published are applied
+    // to it again and only the lazy tables are copied over. Otherwise (a reader
+    // still has it, or after compact, load_snapshot, load_text or more updates
+    // than there are records) the whole store is deep-copied, which is O(n)
+    // and about 100 ms at 100000 publications. The first publish copies it
+    // twice, the second copy is the one the next publish brings up to date.
+    // Estimate of performance: O(u), u = cost of the updates since the last two publishes,
+    // O(n) if the store has to be copied, O(nlogn) if the forest has changed since the last query
+    // Short rationale for estimate: replaying an update costs what it cost the first time
+    void publish_snapshot();
+
+    // Binary snapshot of the whole state. The file holds the string pools,
+    // the columns as flat arrays, every adjacency list (links and their
+    // positions, year index, collaboration graph) in CSR form, the ordered
+    // indexes in their order, the year counts, the grid cells and the trigram
+    // index. Loading copies all of these straight out of the mapped file and
+    // checks that they agree, the hash maps are refilled and the ID lists and
+    // ancestor/interval tables are rebuilt lazily on the next query that needs
+    // them. The format is versioned and in native byte order, files from a
+    // different version or byte order are rejected.
+
+    // Written to path + ".tmp" first and renamed over path once everything has
+    // been flushed, false if any write fails (the old file is then kept).
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: every column is written once
+    bool save_snapshot(std::string const& path) const;
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: bulk copies from the mapped file, hash maps refilled, ordered indexes filled in order
+    bool load_snapshot(std::string const& path);
+
+    // Streaming loader for text dumps, one record per line with ';' between fields:
+    //   A;<affiliation id>;<name>;<x>;<y>
+    //   P;<publication id>;<name>;<year>;<affiliation id>,<affiliation id>,...
+    //   R;<publication id>;<parent publication id>
+    // Empty lines and lines starting with '#' are skipped. The file is read in
+    // chunks of a few MB, each chunk is parsed by threads (0 = one per core)
+    // and its records are added in file order, the same as the batch
+    // operations below. A publication or reference that refers to an ID
+    // further down the file is kept aside and added after the whole file has
+    // been read, the ones whose IDs never turn up are counted in unresolved.
+    // Memory use depends on the chunk size and on the records kept aside, not
+    // on the file size.
+
+    // Estimate of performance: O(m*k + mlogn), m = records, k = affiliations per publication
+    // Short rationale for estimate: parsing is linear and split over threads, adding is the same as the batch operations, records kept aside are tried once more
+    LoadStats load_text(std::string const& path, unsigned int threads = 0);
+
+    // Instrumentation report: calls, latency histograms, hits/misses of the lazily
+    // rebuilt lists and tables, hash table load factors and adjacency list lengths.
+    // Only recorded when compiled with DATASTRUCTURES_STATS, otherwise the
+    // report says so and nothing is measured.
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: list lengths are computed when the report is made
+    std::string stats_text() const;
+
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: same as stats_text
+    std::string stats_json() const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: fixed number of counters
+    void reset_stats();
+
+    // Memory held, by component (see MemoryUsage).
+    // Estimate of performance: O(n)
+    // Short rationale for estimate: heap parts of the ID strings are summed one by one
+    MemoryUsage memory_usage() const;
+
+    // Rebuilds the internal containers tightly: handles and slots of removed
+    // records are given up (the live ones are renumbered) so the columns only
+    // hold live rows, every adjacency list is cut to its length (inline if it
+    // fits), the name pool keeps only live names, hash tables and vectors lose
+    // their excess capacity and the node arena is rebuilt from scratch.
+    // Meant for quiet periods, views into the data are invalidated.
+    // Estimate of performance: O(n + m), m = links
+    // Short rationale for estimate: ordered sets are refilled in order into a fresh arena, everything else is copied once
+    void compact();
+
+    // Batch operations. Result is the same as calling the single add operation
+    // for each record in order, return value is the number of records added.
+
+    // Estimate of performance: O(mlogn), m = records
+    // Short rationale for estimate: capacity reserved once, ordered indexes O(logn) per record, grid rebuilt at most once
+    unsigned int add_affiliations(std::vector<AffiliationRecord> const& affiliations);
+
+    // Estimate of performance: O(m*k), m = records, k = affiliations per record
+    // Short rationale for estimate: capacity reserved once, one map.find() per affiliation
+    unsigned int add_publications(std::vector<PublicationRecord> const& publications);
+
+    // Estimate of performance: O(mlogn), m = records
+    // Short rationale for estimate: same as add_reference per record
+    unsigned int add_references(std::vector<ReferenceRecord> const& references);
+
+    //Memory of the node containers, the AffiliationID vectors, the grid and
+    //the trigram index, must be declared before them. clear_all leaves these
+    //containers to the arena and gives it back in one go. A copy of a
+    //Datastructures gets an arena of its own but its containers use the
+    //default heap.
+    struct NodeArena {
+        std::pmr::unsynchronized_pool_resource pool;
+        NodeArena() = default;
+        NodeArena(NodeArena const&) {}
+        NodeArena& operator=(NodeArena const&) { return *this; }
+    };
+    NodeArena arena;
+
+    //Set once an AffiliationID too long for the string's own buffer has been
+    //stored: such strings own heap memory, so clear_all has to destroy them.
+    //Assignment only ever sets it, the strings assigned to keep their buffers.
+    struct LongIDs {
+        bool seen = false;
+        LongIDs() = default;
+        LongIDs(LongIDs const&) = default;
+        LongIDs& operator=(LongIDs const& other) { seen = seen || other.seen; return *this; }
+    };
+    LongIDs long_ids;
+
+    //ID vectors. These are only output caches, the maps are the source of truth.
+    //Adds append to a valid cache, removals swap the last ID into the removed
+    //one's place. Order is arbitrary.
+    std::pmr::vector<AffiliationID> affIDList{&arena.pool};
     std::vector<PublicationID> pubIDList;
+    bool affIDList_valid = true;
+    bool pubIDList_valid = true;
+    std::vector<unsigned int> aff_list_pos;  //AffHandle -> index in affIDList
+    std::vector<unsigned int> pub_list_pos;  //PubSlot -> index in pubIDList
+
+    //Dense handle of an interned AffiliationID. AffiliationID strings are only
+    //used at the API boundary, everything inside refers to affiliations by handle.
+    using AffHandle = unsigned int;
+    static constexpr AffHandle NO_HANDLE = std::numeric_limits<AffHandle>::max();
+
+    //Dense slot of a publication, publications refer to each other by slot.
+    using PubSlot = unsigned int;
+    static constexpr PubSlot NO_SLOT = std::numeric_limits<PubSlot>::max();
+
+    //Names are stored back to back in NameStore::pool, a column only keeps where.
+    struct NameRef {
+        std::size_t offset = 0;
+        unsigned int length = 0;
+    };
+
+    //Names of affiliations (affs, by AffHandle) and publications (pubs, by
+    //PubSlot) and the indexes ordering them by name. The indexes hold only
+    //handles and slots and compare their names in pool, ties by handle, so
+    //they are kept together with it: a copy binds its indexes to its own pool.
+    //A name must not change while its handle is in an index.
+    struct NameStore {
+        struct Order {
+            NameStore const* store = nullptr;
+            std::vector<NameRef> NameStore::*column = nullptr;
 
-    //Structs
-    struct AffiliationData {
-        Name name;
-        Coord coords;
-        std::vector<PublicationID> related_pubs;
+            //Lookups by name directly, without making a key
+            using is_transparent = void;
+            std::string_view name(unsigned int h) const { return store->of((store->*column)[h]); }
+            bool operator()(unsigned int a, unsigned int b) const
+            {
+                int order = name(a).compare(name(b));
+                return order != 0 ? order < 0 : a < b;
+            }
+            bool operator()(std::string_view a, unsigned int b) const { return a < name(b); }
+            bool operator()(unsigned int a, std::string_view b) const { return name(a) < b; }
+        };
+        using Index = std::pmr::set<unsigned int, Order>;
+
+        std::string pool;
+        std::vector<NameRef> affs;
+        std::vector<NameRef> pubs;
+        Index affs_by_name;
+        Index pubs_by_name;
+
+        explicit NameStore(std::pmr::memory_resource* resource);
+        NameStore(NameStore const& other);
+        NameStore& operator=(NameStore const& other);
+        NameStore& operator=(NameStore&& other);
+
+        std::string_view of(NameRef ref) const { return std::string_view(pool).substr(ref.offset, ref.length); }
+        //Indexes filled again from other's, which has to be ordered the same
+        void refill(NameStore const& other);
+    };
+    NameStore names{&arena.pool};
+
+    //Interning table. Handles index aff_ids and the affiliation columns,
+    //handles of removed affiliations are kept in free_handles and reused.
+    std::pmr::unordered_map<AffiliationID, AffHandle> aff_handles{&arena.pool};
+    std::pmr::vector<AffiliationID> aff_ids{&arena.pool};
+    std::vector<AffHandle> free_handles;
+
+    //Affiliation columns, indexed by AffHandle. aff_pub_pos[h][i] is the
+    //position of h in pub_affs[aff_pubs[h][i]] and pub_aff_pos the other way
+    //round, so a link can be removed from both lists in O(1) by swapping with
+    //the last entry. pub_ref_pos[s] is s's position in its parent's pub_refs.
+    std::vector<int> aff_x;
+    std::vector<int> aff_y;
+    ListPool<PubSlot, 2> aff_pubs;
+    ListPool<unsigned int, 2> aff_pub_pos;
+    ListPool<std::pair<Year, PubSlot>, 2> aff_years;
+
+    //Publication columns, indexed by PubSlot. pub_ids is NO_PUBLICATION
+    //for slots in free_slots.
+    FlatHashMap<PublicationID, PubSlot> publications_map;
+    std::vector<PublicationID> pub_ids;
+    std::vector<Year> pub_years;
+    std::vector<PubSlot> pub_parents;
+    ListPool<AffHandle, 2> pub_affs;
+    ListPool<unsigned int, 2> pub_aff_pos;
+    ListPool<PubSlot, 2> pub_refs;
+    std::vector<unsigned int> pub_ref_pos;
+    std::vector<PubSlot> free_slots;
+
+    //Maps. Flat tables for the integer and coordinate keys, bulk loads reserve up front.
+    FlatHashMap<Coord, AffHandle> coord_to_id_map;
+
+    //Ordered indexes, updated in O(logn) by every add, coordinate change and removal.
+    //Ties are broken by handle so that the orders are deterministic.
+    //The name indexes are in names.
+    std::pmr::set<std::tuple<unsigned long long, int, AffHandle>> affs_by_distance{&arena.pool};
+
+    //Trigram index of publication names, pub_trigrams[t] lists the slots
+    //whose name contains trigram t. Removals only count the entries left
+    //behind (queries check every candidate's name anyway), the index is
+    //rebuilt once more than half of it is garbage.
+    std::pmr::unordered_map<std::uint32_t, std::pmr::vector<PubSlot>> pub_trigrams{&arena.pool};
+    std::size_t pub_trigram_entries = 0;
+    std::size_t pub_trigram_garbage = 0;
+
+private:
+
+    //Spatial grid for the coordinate queries. Affiliations are bucketed into
+    //square cells of grid_cell_size, the cell size is re-chosen whenever the
+    //affiliation count has doubled or halved since the last rebuild.
+    int grid_cell_size = 1;
+    std::size_t grid_built_for = 0;
+    Coord grid_min = NO_COORD;
+    Coord grid_max = NO_COORD;
+    std::pmr::unordered_map<unsigned long long, std::pmr::vector<AffHandle>> grid{&arena.pool};
+
+    void grid_insert(AffHandle h, Coord xy);
+    void grid_erase(AffHandle h, Coord xy);
+    void grid_rebuild();
+    long long grid_cell(long long v) const;
+
+    //Calls visit(cell) for every occupied cell in the given cell range.
+    template <typename Visit>
+    void grid_visit_range(long long cx1, long long cy1, long long cx2, long long cy2, Visit visit) const;
+
+    //count closest of handles by distance from xy, ties by y coordinate (like get_affiliations_distance_increasing)
+    std::vector<AffiliationID> sort_by_distance_from(Coord xy, std::vector<AffHandle> const& handles, std::size_t count) const;
+    //Same with the squared distances already computed, dist[i] belongs to handles[i]
+    std::vector<AffiliationID> sort_by_distance(std::vector<AffHandle> const& handles,
+                                                std::vector<unsigned long long> const& dist, std::size_t count) const;
+
+    //Bodies of the batch operations for records [first, last), capacity is
+    //reserved by the caller. If deferred isn't null, records that refer to
+    //IDs not in the store are appended to it instead of being dropped.
+    unsigned int add_affiliation_range(AffiliationRecord const* first, AffiliationRecord const* last);
+    unsigned int add_publication_range(PublicationRecord const* first, PublicationRecord const* last,
+                                       std::vector<PublicationRecord>* deferred);
+    unsigned int add_reference_range(ReferenceRecord const* first, ReferenceRecord const* last,
+                                     std::vector<ReferenceRecord>* deferred);
+
+    //Interning helpers. find_handle returns NO_HANDLE for unknown IDs.
+    AffHandle find_handle(AffiliationID const& id) const;
+    AffHandle new_handle(AffiliationID const& id);
+    void release_handle(AffHandle h);
+
+    //Slot helpers, same as above. find_slot returns NO_SLOT for unknown IDs.
+    PubSlot find_slot(PublicationID id) const;
+    PubSlot new_slot(PublicationID id);
+    void release_slot(PubSlot s);
+
+    NameRef store_name(Name const& name);
+    std::string_view name_of(NameRef ref) const;
+
+    //Keep names.pubs_by_name and pub_trigrams in sync with names.pubs[s]
+    void index_publication_name(PubSlot s);
+    void unindex_publication_name(PubSlot s);
+    void pub_trigrams_rebuild();
+
+    //Collaboration graph. aff_links[h] holds (g, weight) for every g that
+    //shares publications with h, link_pos maps link_key(h, g) to the position
+    //of g in aff_links[h] so that weights change and links go away in O(1).
+    ListPool<std::pair<AffHandle, Weight>, 2> aff_links;
+    FlatHashMap<unsigned long long, unsigned int> link_pos;
+    static unsigned long long link_key(AffHandle h, AffHandle g) { return (static_cast<unsigned long long>(h) << 32) | g; }
+    void change_link_weight(AffHandle h, AffHandle g, Weight delta);
+    void links_rebuild();
+    //Sorted affiliations of s without duplicates, leaving out position skip
+    std::vector<AffHandle> distinct_affiliations(PubSlot s, unsigned int skip) const;
+    Weight link_weight(AffHandle h, AffHandle g) const;
+
+    //Turns prev (filled by a search from source) into the path ending at target
+    Path path_to(AffHandle source, AffHandle target, std::vector<AffHandle> const& prev) const;
+    Coord aff_coord(AffHandle h) const { return {aff_x[h], aff_y[h]}; }
+
+    //Per-affiliation year index. aff_years[h] holds the same publications as
+    //aff_pubs[h] ordered by (year, name, ID), kept sorted on every change.
+    bool year_order(std::pair<Year, PubSlot> const& e1, std::pair<Year, PubSlot> const& e2) const;
+    void year_index_insert(AffHandle h, PubSlot s);
+    void year_index_erase(AffHandle h, PubSlot s);
+    //Part of aff_years[h] with years from..to
+    std::pair<std::pair<Year, PubSlot> const*, std::pair<Year, PubSlot> const*> year_range(AffHandle h, Year from, Year to) const;
+
+    //Fenwick tree of publication counts by year, year y is index y + 1.
+    //Left empty until the first publication is added.
+    std::vector<unsigned int> year_tree;
+    void year_tree_add(Year year, int delta);
+    unsigned int year_tree_prefix(unsigned int years) const;
+
+    //Binary lifting over the reference forest. lift[j][s] is the 2^j:th parent
+    //of s or NO_SLOT. A reference to a publication without references of its
+    //own only updates that publication's row, other changes to the forest
+    //clear ancestors_valid and ancestors_update() rebuilds on the next query.
+    std::vector<std::vector<PubSlot>> lift = std::vector<std::vector<PubSlot>>(1);
+    std::vector<unsigned int> pub_depth;
+    bool ancestors_valid = true;
+
+    //Adds child to parent's references, false if it would make a cycle
+    bool link_reference(PubSlot child, PubSlot parent);
+    void unlink_reference(PubSlot child);
+
+    //O(1) maintenance of the ID lists and the affiliation/publication links
+    void list_affiliation(AffHandle h);
+    void unlist_affiliation(AffHandle h);
+    void list_publication(PubSlot s);
+    void unlist_publication(PubSlot s);
+    void link_affiliation(AffHandle h, PubSlot s);
+    void unlink_affiliation(PubSlot s, unsigned int j);
+    void ancestors_update();
+    void ancestors_extend(PubSlot s);
+    PubSlot kth_ancestor(PubSlot s, unsigned int k) const;
+    PubSlot lowest_common_ancestor(PubSlot a, PubSlot b) const;
+    bool is_ancestor_slot(PubSlot ancestor, PubSlot s) const;
+
+    //DFS interval labels of the reference forest. The subtree of s is
+    //dfs_order[pre_order[s] .. subtree_end[s]). New roots are appended,
+    //other changes clear intervals_valid and intervals_update() rebuilds.
+    std::vector<PubSlot> dfs_order;
+    std::vector<unsigned int> pre_order;
+    std::vector<unsigned int> subtree_end;
+    bool intervals_valid = true;
+    void intervals_update();
+
+    //Query bodies that only read, the lazy tables they use must be up to date.
+    //Shared by the public queries and Snapshot.
+    PublicationID closest_common_parent_of(PublicationID id1, PublicationID id2) const;
+    PublicationID kth_parent_of(PublicationID id, unsigned int k) const;
+    bool is_ancestor_of(PublicationID ancestorid, PublicationID id) const;
+    unsigned int references_count_of(PublicationID id) const;
+    std::vector<PublicationID> all_references_of(PublicationID id) const;
+
+    //Latest published snapshot, only accessed with std::atomic_load/atomic_store.
+    //Not part of the data: copying or assigning a Datastructures leaves it alone.
+    struct PublishedSnapshot {
+        std::shared_ptr<const Snapshot> ptr;
+        PublishedSnapshot() = default;
+        PublishedSnapshot(PublishedSnapshot const&) {}
+        PublishedSnapshot& operator=(PublishedSnapshot const&) { return *this; }
     };
+    PublishedSnapshot current_snapshot;
 
-    struct PublicationData {
-        Name name;
-        Year year;
-        std::vector<AffiliationID> related_affs;
-        std::vector<PublicationID> references;
-        PublicationID parent;
+    //Updates made since the last two publishes, applied again to the snapshot
+    //before the current one by publish_snapshot. Only kept once something has
+    //been published, and not part of the data like current_snapshot.
+    struct UpdateLog {
+        using Update = std::function<void(Datastructures&)>;
+        std::vector<Update> current;        //since the last publish
+        std::vector<Update> previous;       //between the two publishes before that
+        std::size_t current_records = 0;    //a batch counts each of its records
+        bool current_lost = false;          //an update that can't be applied again
+        bool previous_lost = false;
+        bool on = false;
+        std::shared_ptr<Snapshot> spare;    //published before the current one
+        UpdateLog() = default;
+        UpdateLog(UpdateLog const&) {}
+        UpdateLog& operator=(UpdateLog const&) { return *this; }
     };
+    UpdateLog update_log;
+    template <typename Update>
+    void log_update(std::size_t records, Update&& update);
+    void log_lost();
+
+#ifdef DATASTRUCTURES_STATS
+    //Snapshots point to the stats of the Datastructures they were made from,
+    //so that queries on them are reported there. Copies start from zero.
+    struct SharedStats {
+        std::shared_ptr<DatastructuresStats> ptr = std::make_shared<DatastructuresStats>();
+        SharedStats() = default;
+        SharedStats(SharedStats const&) {}
+        SharedStats& operator=(SharedStats const&) { return *this; }
+    };
+    SharedStats stats;
+#endif
+
+    //Fills an empty Datastructures from a save_snapshot file, false if the file is broken
+    bool read_snapshot(char const* data, std::size_t size);
+
+    friend class Snapshot;
+};
+
+// Copy of Datastructures made by publish_snapshot(). All queries are const
+// and only read, so a Snapshot can be shared between threads. It isn't
+// changed while anyone holds it, publish_snapshot only reuses it once the
+// last reader has let go.
+// Estimates are the same as for the corresponding Datastructures queries
+// with the lazy tables already up to date. With DATASTRUCTURES_STATS the
+// queries are recorded in the stats of the Datastructures the snapshot was
+// made from.
+class Snapshot
+{
+public:
+    explicit Snapshot(Datastructures const& ds);
+
+    unsigned int get_affiliation_count() const { return data_.get_affiliation_count(); }
+    std::vector<AffiliationID> get_all_affiliations() const;
+    Name get_affiliation_name(AffiliationID id) const { return data_.get_affiliation_name(id); }
+    Coord get_affiliation_coord(AffiliationID id) const { return data_.get_affiliation_coord(id); }
+    std::vector<AffiliationID> get_affiliations_alphabetically() const { return data_.get_affiliations_alphabetically(); }
+    std::vector<AffiliationID> get_affiliations_distance_increasing() const { return data_.get_affiliations_distance_increasing(); }
+    std::vector<AffiliationID> get_affiliations_alphabetically(unsigned int offset, unsigned int count) const
+    { return data_.get_affiliations_alphabetically(offset, count); }
+    std::vector<AffiliationID> get_affiliations_distance_increasing(unsigned int offset, unsigned int count) const
+    { return data_.get_affiliations_distance_increasing(offset, count); }
+    std::vector<AffiliationID> get_affiliations_distance_increasing_from(Coord xy) const
+    { return data_.get_affiliations_distance_increasing_from(xy); }
+    std::vector<AffiliationID> find_affiliations_by_prefix(Name const& prefix) const { return data_.find_affiliations_by_prefix(prefix); }
+    std::vector<AffiliationID> find_affiliations_by_name(Name const& name) const { return data_.find_affiliations_by_name(name); }
+    std::vector<PublicationID> find_publications_by_name(Name const& name) const { return data_.find_publications_by_name(name); }
+    std::vector<PublicationID> find_publications_by_substring(Name const& substring) const
+    { return data_.find_publications_by_substring(substring); }
+
+    std::vector<Connection> get_connected_affiliations(AffiliationID id) const { return data_.get_connected_affiliations(id); }
+    std::vector<Connection> get_all_connections() const { return data_.get_all_connections(); }
+    Path get_any_path(AffiliationID source, AffiliationID target) const { return data_.get_any_path(source, target); }
+    Path get_path_with_least_affiliations(AffiliationID source, AffiliationID target) const
+    { return data_.get_path_with_least_affiliations(source, target); }
+    Path get_path_of_least_friction(AffiliationID source, AffiliationID target) const
+    { return data_.get_path_of_least_friction(source, target); }
+    PathWithDist get_shortest_path(AffiliationID source, AffiliationID target) const { return data_.get_shortest_path(source, target); }
+    std::vector<PublicationInfluence> get_top_publications_by_influence(unsigned int k, unsigned int threads = 0) const
+    { return data_.get_top_publications_by_influence(k, threads); }
+    AffiliationID find_affiliation_with_coord(Coord xy) const { return data_.find_affiliation_with_coord(xy); }
+
+    std::vector<PublicationID> all_publications() const;
+    Name get_publication_name(PublicationID id) const { return data_.get_publication_name(id); }
+    Year get_publication_year(PublicationID id) const { return data_.get_publication_year(id); }
+    std::vector<AffiliationID> get_affiliations(PublicationID id) const { return data_.get_affiliations(id); }
+    std::vector<PublicationID> get_direct_references(PublicationID id) const { return data_.get_direct_references(id); }
+    std::vector<PublicationID> get_publications(AffiliationID id) const { return data_.get_publications(id); }
+    PublicationID get_parent(PublicationID id) const { return data_.get_parent(id); }
+    std::vector<std::pair<Year, PublicationID>> get_publications_after(AffiliationID affiliationid, Year year) const
+    { return data_.get_publications_after(affiliationid, year); }
+    std::vector<std::pair<Year, PublicationID>> get_publications_between(AffiliationID affiliationid, Year from, Year to) const
+    { return data_.get_publications_between(affiliationid, from, to); }
+    unsigned int get_publication_count_between(AffiliationID affiliationid, Year from, Year to) const
+    { return data_.get_publication_count_between(affiliationid, from, to); }
+    unsigned int get_total_publication_count_between(Year from, Year to) const
+    { return data_.get_total_publication_count_between(from, to); }
+    std::vector<std::pair<AffiliationID, unsigned int>> get_top_affiliations_between(Year from, Year to, unsigned int k) const
+    { return data_.get_top_affiliations_between(from, to, k); }
+    std::vector<PublicationID> get_referenced_by_chain(PublicationID id) const { return data_.get_referenced_by_chain(id); }
+    std::vector<PublicationID> get_all_references(PublicationID id) const;
 
-    //Maps
-    std::unordered_map<AffiliationID, AffiliationData> affiliations_map;
-    std::unordered_map<PublicationID, PublicationData> publications_map;
-    std::unordered_map<Coord, AffiliationID, CoordHash> coord_to_id_map;
+    std::vector<AffiliationID> get_affiliations_closest_to(Coord xy) const { return data_.get_affiliations_closest_to(xy); }
+    std::vector<AffiliationID> get_affiliations_nearest(Coord xy, unsigned int k) const { return data_.get_affiliations_nearest(xy, k); }
+    std::vector<AffiliationID> get_affiliations_within_radius(Coord xy, int radius) const { return data_.get_affiliations_within_radius(xy, radius); }
+    std::vector<AffiliationID> get_affiliations_in_rectangle(Coord corner1, Coord corner2) const
+    { return data_.get_affiliations_in_rectangle(corner1, corner2); }
 
-    //Flag variables to avoid running functions unnecessarily
-    bool alphabetical = false;
-    bool distance_increasing = false;
+    PublicationID get_closest_common_parent(PublicationID id1, PublicationID id2) const;
+    PublicationID get_kth_parent(PublicationID id, unsigned int k) const;
+    bool is_ancestor(PublicationID ancestorid, PublicationID id) const;
+    unsigned int get_all_references_count(PublicationID id) const;
 
 private:
+    Datastructures data_;
 
+    //publish_snapshot brings data_ up to date when it reuses a snapshot
+    friend class Datastructures;
 };
 
 #endif // DATASTRUCTURES_HH
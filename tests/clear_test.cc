@@ -0,0 +1,126 @@
+// Clear_test.cc
+//
+// clear_all drops the containers held in the arena without destroying their
+// elements, unless an AffiliationID has been too long for the string's own
+// buffer. Either way the store has to be empty afterwards and then work like
+// a fresh one, also for copies (whose containers are on the default heap),
+// after compact and after load_snapshot. Build it with -fsanitize=address as
+// well to check that nothing leaks.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/clear_test.cc -o clear_test
+//   ./clear_test
+// Exit status is 1 on any failure.
+
+#include "datastructures.hh"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace
+{
+const char* const SNAPSHOT_FILE = "clear_test.snap";
+const std::string LONG_PREFIX = "an_affiliation_id_longer_than_the_buffer_";
+
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+// Same records every time, affiliation IDs start with prefix
+void fill(Datastructures& ds, std::string const& prefix)
+{
+    for ( int i = 0; i < 300; ++i ) { ds.add_affiliation(prefix + std::to_string(i), "N" + std::to_string(i), {i, 2 * i}); }
+    for ( PublicationID p = 0; p < 2000; ++p ) {
+        ds.add_publication(p, "Publication " + std::to_string(p), 2000 + p % 20,
+                           {prefix + std::to_string(p % 300), prefix + std::to_string(p * 7 % 300)});
+    }
+    for ( PublicationID p = 1; p < 2000; ++p ) { ds.add_reference(p, (p - 1) / 2); }
+    ds.remove_affiliation(prefix + "5");
+    ds.remove_publication(17);
+}
+
+// A few answers of every kind of container that clear_all drops
+std::string answers(Datastructures& ds)
+{
+    std::string out = std::to_string(ds.get_affiliation_count()) + " " + std::to_string(ds.all_publications().size());
+    for ( auto const& a : ds.get_affiliations_alphabetically(0, 5) ) { out += " " + a; }
+    for ( auto const& a : ds.get_affiliations_nearest({10, 20}, 3) ) { out += " " + a; }
+    for ( auto const& a : ds.view_affiliations(3) ) { out += " " + a; }
+    for ( auto p : ds.find_publications_by_substring("ation 19") ) { out += " " + std::to_string(p); }
+    out += " " + std::to_string(ds.get_kth_parent(1999, 3)) + " " + std::to_string(ds.get_all_affiliations().size());
+    return out;
+}
+
+void check_empty(Datastructures& ds, std::string const& what)
+{
+    check(ds.get_affiliation_count() == 0 && ds.all_publications().empty() && ds.get_all_affiliations().empty()
+          && ds.get_affiliations_nearest({0, 0}, 1).empty() && ds.find_publications_by_substring("Pub").empty(),
+          "empty after clear_all " + what);
+}
+}
+
+int main()
+{
+    for ( std::string const& prefix : {std::string("A"), LONG_PREFIX} ) {
+        std::string ids = prefix == "A" ? "short IDs" : "long IDs";
+        Datastructures fresh;
+        fill(fresh, prefix);
+        auto expected = answers(fresh);
+
+        Datastructures ds;
+        fill(ds, "B");
+        fill(ds, LONG_PREFIX + "B");
+        ds.clear_all();
+        check_empty(ds, "with " + ids + " before");
+        fill(ds, prefix);
+        check(answers(ds) == expected, "refilled with " + ids);
+
+        //Twice in a row, and after compact
+        ds.clear_all();
+        ds.clear_all();
+        check_empty(ds, "twice");
+        fill(ds, prefix);
+        ds.compact();
+        ds.clear_all();
+        fill(ds, prefix);
+        check(answers(ds) == expected, "after compact with " + ids);
+
+        //A copy and an assigned store
+        Datastructures copy(ds);
+        copy.clear_all();
+        check_empty(copy, "of a copy");
+        fill(copy, prefix);
+        check(answers(copy) == expected, "copy refilled with " + ids);
+        Datastructures assigned;
+        fill(assigned, LONG_PREFIX);
+        assigned = ds;
+        assigned.clear_all();
+        fill(assigned, prefix);
+        check(answers(assigned) == expected, "assigned store refilled with " + ids);
+
+        //Loaded over a store with other IDs
+        check(ds.save_snapshot(SNAPSHOT_FILE), "save");
+        Datastructures loaded;
+        fill(loaded, prefix == "A" ? LONG_PREFIX : "A");
+        check(loaded.load_snapshot(SNAPSHOT_FILE), "load");
+        loaded.clear_all();
+        check_empty(loaded, "after a load");
+        fill(loaded, prefix);
+        check(answers(loaded) == expected, "loaded store refilled with " + ids);
+    }
+    std::remove(SNAPSHOT_FILE);
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "clear ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,159 @@
+// Compact_test.cc
+//
+// After most of the store has been removed, compact() has to give the memory
+// of the removed records back: memory_usage() afterwards may only be a little
+// more than that of a store built from the survivors alone. The survivors are
+// the newest records, so their handles and slots are at the end and the
+// columns only shrink if compact renumbers them. Every query has to give the
+// same answers before and after, and the store has to keep working.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/compact_test.cc -o compact_test
+//   ./compact_test [publications, default 100000]
+// Exit status is 1 on any failure.
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace harness;
+
+namespace
+{
+const std::size_t SLACK_BYTES = 4096;
+
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::string text(AffiliationID const& id) { return id; }
+std::string text(PublicationID id) { return std::to_string(id); }
+
+// Answers of the queries that depend on handles, slots and lists, as text
+std::vector<std::string> answers(Datastructures& ds)
+{
+    std::vector<std::string> out;
+    auto join = [&](auto const& ids)
+    {
+        std::string line;
+        for ( auto const& id : ids ) { line += " " + text(id); }
+        out.push_back(line);
+    };
+
+    auto affs = ds.get_all_affiliations();
+    std::sort(affs.begin(), affs.end());
+    for ( auto const& a : affs ) {
+        Coord xy = ds.get_affiliation_coord(a);
+        out.push_back(a + " " + ds.get_affiliation_name(a) + " " + std::to_string(xy.x) + " " + std::to_string(xy.y));
+        auto pubs = ds.get_publications(a);
+        std::sort(pubs.begin(), pubs.end());
+        join(pubs);
+        std::vector<std::string> connections;
+        for ( auto const& c : ds.get_connected_affiliations(a) ) { connections.push_back(c.aff2 + " " + std::to_string(c.weight)); }
+        std::sort(connections.begin(), connections.end());
+        out.insert(out.end(), connections.begin(), connections.end());
+        for ( auto const& p : ds.get_publications_after(a, 0) ) { out.push_back(std::to_string(p.first) + " " + std::to_string(p.second)); }
+    }
+    join(ds.get_affiliations_alphabetically());
+    join(ds.get_affiliations_distance_increasing());
+    join(ds.get_affiliations_nearest({5000000, 5000000}, 10));
+
+    auto pubs = ds.all_publications();
+    std::sort(pubs.begin(), pubs.end());
+    for ( auto p : pubs ) {
+        out.push_back(std::to_string(p) + " " + ds.get_publication_name(p) + " " + std::to_string(ds.get_publication_year(p))
+                      + " " + std::to_string(ds.get_parent(p)) + " " + std::to_string(ds.get_kth_parent(p, 2)));
+        auto affiliations = ds.get_affiliations(p);
+        std::sort(affiliations.begin(), affiliations.end());
+        join(affiliations);
+        auto references = ds.get_all_references(p);
+        std::sort(references.begin(), references.end());
+        join(references);
+        join(ds.get_referenced_by_chain(p));
+        join(ds.find_publications_by_name(ds.get_publication_name(p)));
+    }
+    if ( affs.size() >= 2 ) { out.push_back(std::to_string(ds.get_path_with_least_affiliations(affs.front(), affs.back()).size())); }
+    out.push_back(std::to_string(ds.get_total_publication_count_between(0, 3000)));
+    return out;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    unsigned int affiliations = n / 10;
+    const unsigned int KEEP_PUBS = 3;
+    const unsigned int KEEP_AFFS = 2;
+
+    rand_engine.seed(1);
+    Datastructures ds;
+    fill(ds, affiliations, n);
+    MemoryUsage full = ds.memory_usage();
+
+    //Everything but the newest few goes
+    for ( unsigned int i = 0; i + KEEP_PUBS < n; ++i ) { ds.remove_publication(publication_id(i)); }
+    for ( unsigned int i = 0; i + KEEP_AFFS < affiliations; ++i ) { ds.remove_affiliation(affiliation_id(i)); }
+
+    auto before = answers(ds);
+    ds.compact();
+    MemoryUsage compacted = ds.memory_usage();
+    check(answers(ds) == before, "queries give the same answers after compact");
+
+    //The same survivors in a store of their own
+    Datastructures fresh;
+    for ( auto const& a : ds.get_all_affiliations() ) {
+        fresh.add_affiliation(a, ds.get_affiliation_name(a), ds.get_affiliation_coord(a));
+    }
+    for ( auto p : ds.all_publications() ) {
+        fresh.add_publication(p, ds.get_publication_name(p), ds.get_publication_year(p), ds.get_affiliations(p));
+    }
+    for ( auto p : ds.all_publications() ) {
+        for ( auto r : ds.get_direct_references(p) ) { fresh.add_reference(r, p); }
+    }
+    fresh.compact();
+    MemoryUsage minimum = fresh.memory_usage();
+
+    std::cout << n << " publications: " << full.total() << " bytes, " << KEEP_PUBS << " left after compact: "
+              << compacted.total() << " bytes, in a store of their own: " << minimum.total() << " bytes" << std::endl;
+    check(compacted.maps <= minimum.maps + SLACK_BYTES, "maps");
+    check(compacted.id_lists <= minimum.id_lists + SLACK_BYTES, "ID lists");
+    check(compacted.columns <= minimum.columns + SLACK_BYTES, "columns");
+    check(compacted.adjacency <= minimum.adjacency + SLACK_BYTES, "adjacency lists");
+    check(compacted.strings <= minimum.strings + SLACK_BYTES, "strings");
+    check(compacted.indexes <= minimum.indexes + SLACK_BYTES, "indexes");
+
+    //Renumbered handles and slots keep working: the same updates on both stores
+    for ( Datastructures* store : {&ds, &fresh} ) {
+        rand_engine.seed(2);
+        fill(*store, 20, 200);
+        store->remove_publication(publication_id(7));
+        store->remove_affiliation(affiliation_id(3));
+        store->add_reference(publication_id(5), publication_id(n - 1));
+    }
+    check(answers(ds) == answers(fresh), "updates after compact");
+    ds.compact();
+    fresh.compact();
+    check(answers(ds) == answers(fresh), "second compact");
+
+    //Nothing left at all
+    Datastructures empty;
+    for ( auto const& a : ds.get_all_affiliations() ) { ds.remove_affiliation(a); }
+    for ( auto p : ds.all_publications() ) { ds.remove_publication(p); }
+    ds.compact();
+    check(ds.memory_usage().total() <= empty.memory_usage().total() + SLACK_BYTES, "empty store after compact");
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "compact ok" << std::endl;
+    return 0;
+}
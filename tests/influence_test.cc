@@ -0,0 +1,71 @@
+// Influence_test.cc
+//
+// get_top_publications_by_influence on a small forest where the figures can
+// be counted by hand: publication 1 has three direct references and 2 has
+// two, so direct_citations has to be the number of direct references and not
+// just whether the publication has a parent. The scores have to be the same
+// whatever the number of threads.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/influence_test.cc -o influence_test
+//   ./influence_test
+// Exit status is 1 on any failure.
+
+#include "datastructures.hh"
+
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace
+{
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+}
+
+int main()
+{
+    //1 references 2, 3 and 4, 2 references 5 and 6, 7 is on its own
+    Datastructures ds;
+    ds.add_affiliation("a", "A", {1, 1});
+    for ( PublicationID p = 1; p <= 7; ++p ) { ds.add_publication(p, "P" + std::to_string(p), 2000, {"a"}); }
+    for ( PublicationID r : {2, 3, 4} ) { ds.add_reference(r, 1); }
+    for ( PublicationID r : {5, 6} ) { ds.add_reference(r, 2); }
+
+    std::map<PublicationID, unsigned int> direct{{1, 3}, {2, 2}, {3, 0}, {4, 0}, {5, 0}, {6, 0}, {7, 0}};
+    std::map<PublicationID, unsigned int> transitive{{1, 0}, {2, 1}, {3, 1}, {4, 1}, {5, 2}, {6, 2}, {7, 0}};
+
+    auto one = ds.get_top_publications_by_influence(7, 1);
+    auto four = ds.get_top_publications_by_influence(7, 4);
+    check(one.size() == 7 && four.size() == 7, "all publications are ranked");
+    for ( std::size_t i = 0; i < one.size() && i < four.size(); ++i ) {
+        auto const& info = one[i];
+        std::string id = std::to_string(info.id);
+        check(info.direct_citations == direct[info.id], "direct_citations of " + id);
+        check(info.direct_citations == ds.get_direct_references(info.id).size(), "direct_citations of " + id + " against get_direct_references");
+        check(info.transitive_citations == transitive[info.id], "transitive_citations of " + id);
+        check(four[i].id == info.id && std::abs(four[i].score - info.score) < 1e-9, "same ranking on 4 threads at " + std::to_string(i));
+        if ( i > 0 ) { check(one[i - 1].score >= info.score, "highest score first"); }
+    }
+
+    //After a removal the parent has one direct reference less
+    ds.remove_publication(2);
+    for ( auto const& info : ds.get_top_publications_by_influence(6, 1) ) {
+        if ( info.id == 1 ) { check(info.direct_citations == 2, "direct_citations after a removal"); }
+    }
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "influence ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+// Load_text_test.cc
+//
+// load_text has to add the records in file order, the same as calling the
+// single add operations line by line, and records that refer to IDs further
+// down the file (even in a later chunk) have to be added once the whole file
+// has been read. Records whose IDs never turn up are counted in unresolved,
+// lines that can't be parsed in bad_lines.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/load_text_test.cc -o load_text_test
+//   ./load_text_test
+// Exit status is 1 on any failure.
+
+#include "datastructures.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+const char* const TEXT_FILE = "load_text_test.txt";
+
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+}
+
+int main()
+{
+    //Small file, every kind of record before the IDs it refers to
+    {
+        std::ofstream text(TEXT_FILE);
+        text << "P;2;Second;2001;b\n"   //b comes later
+             << "A;a;First;1;1\n"
+             << "R;3;1\n"               //both come later
+             << "P;1;First;2000;a\n"
+             << "A;a;Second;5;5\n"      //already there, the first one stays
+             << "A;b;B;2;2\n"
+             << "P;3;Third;2002;a,b\n"
+             << "R;2;1\n"               //2 was kept aside above
+             << "R;2;3\n"               //moves 2 under 3, in file order
+             << "R;9;1\n"               //9 is nowhere
+             << "P;4;Fourth;2003;c\n"   //c is nowhere
+             << "not a record\n";
+    }
+    for ( unsigned int threads : {1u, 4u} ) {
+        std::string in = " on " + std::to_string(threads) + " threads";
+        Datastructures ds;
+        LoadStats stats = ds.load_text(TEXT_FILE, threads);
+        check(stats.opened && stats.lines == 12, "all lines read" + in);
+        check(stats.bad_lines == 1, "bad_lines" + in);
+        check(stats.unresolved == 2, "unresolved" + in);
+        check(stats.affiliations == 2 && stats.publications == 3 && stats.references == 3, "records added" + in);
+        check(ds.get_affiliation_name("a") == "First", "first of the duplicates" + in);
+        check(ds.get_affiliations(2) == std::vector<AffiliationID>{"b"}, "publication kept aside" + in);
+        check(ds.get_parent(3) == 1 && ds.get_parent(2) == 3, "references kept aside, in file order" + in);
+        check(ds.get_publication_name(4) == NO_NAME, "publication with a missing affiliation" + in);
+    }
+
+    //Large enough for several chunks: references first, then publications,
+    //then the affiliations they all belong to
+    const PublicationID n = 200000;
+    {
+        std::ofstream text(TEXT_FILE);
+        for ( PublicationID p = 1; p < n; ++p ) { text << "R;" << p << ";" << p - 1 << "\n"; }
+        for ( PublicationID p = 0; p < n; ++p ) { text << "P;" << p << ";Publication " << p << ";2000;last\n"; }
+        text << "A;last;Last;7;7\n";
+    }
+    Datastructures ds;
+    LoadStats stats = ds.load_text(TEXT_FILE, 2);
+    check(stats.bytes > 8u << 20, "file spans several chunks");
+    check(stats.affiliations == 1 && stats.publications == n && stats.references == n - 1, "records across chunks");
+    check(stats.unresolved == 0 && stats.bad_lines == 0, "nothing dropped across chunks");
+    check(ds.get_referenced_by_chain(n - 1).size() == n - 1, "reference chain across chunks");
+    std::remove(TEXT_FILE);
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "load_text ok" << std::endl;
+    return 0;
+}
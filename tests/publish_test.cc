@@ -0,0 +1,142 @@
+// Publish_test.cc
+//
+// publish_snapshot reuses the snapshot before the current one by applying
+// the updates made since then again, and copies the store when it can't
+// (a reader still holds that snapshot, after compact or a clear). Whichever
+// way it was made, every published snapshot has to give exactly the same
+// answers, in the same order, as the store had when it was published, and
+// a snapshot a reader holds must not change under it.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/publish_test.cc -o publish_test
+//   ./publish_test [rounds, default 300]
+// Exit status is 1 on any failure.
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace harness;
+
+namespace
+{
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::string text(AffiliationID const& id) { return id; }
+std::string text(PublicationID id) { return std::to_string(id); }
+std::string text(Connection const& c) { return c.aff1 + "-" + c.aff2 + ":" + std::to_string(c.weight); }
+std::string text(std::pair<Year, PublicationID> const& p) { return std::to_string(p.first) + ":" + std::to_string(p.second); }
+
+// Answers of the queries, in the order the store or snapshot gives them
+template <typename Store>
+std::vector<std::string> answers(Store& store)
+{
+    std::vector<std::string> out;
+    auto join = [&](auto const& ids)
+    {
+        std::string line;
+        for ( auto const& id : ids ) { line += " " + text(id); }
+        out.push_back(line);
+    };
+
+    auto affs = store.get_all_affiliations();
+    join(affs);
+    join(store.get_affiliations_alphabetically());
+    join(store.get_affiliations_distance_increasing());
+    for ( auto const& a : affs ) {
+        Coord xy = store.get_affiliation_coord(a);
+        out.push_back(a + " " + store.get_affiliation_name(a) + " " + std::to_string(xy.x) + " " + std::to_string(xy.y));
+        join(store.get_publications(a));
+        join(store.get_connected_affiliations(a));
+        join(store.get_publications_after(a, 0));
+        join(store.get_affiliations_nearest(xy, 3));
+    }
+    auto pubs = store.all_publications();
+    join(pubs);
+    for ( auto p : pubs ) {
+        out.push_back(std::to_string(p) + " " + store.get_publication_name(p) + " " + std::to_string(store.get_publication_year(p))
+                      + " " + std::to_string(store.get_kth_parent(p, 2)) + " " + std::to_string(store.get_all_references_count(p)));
+        join(store.get_affiliations(p));
+        join(store.get_direct_references(p));
+        join(store.get_referenced_by_chain(p));
+        join(store.get_all_references(p));
+        join(store.find_publications_by_name(store.get_publication_name(p)));
+    }
+    out.push_back(std::to_string(store.get_total_publication_count_between(0, 3000)));
+    return out;
+}
+
+// One random update, IDs are drawn from a small range so that they collide
+void update(Datastructures& ds)
+{
+    const unsigned int AFFS = 40;
+    const unsigned int PUBS = 200;
+    auto aff = [&]() { return affiliation_id(random_in_range(0u, AFFS)); };
+    auto pub = [&]() { return publication_id(random_in_range(0u, PUBS)); };
+    switch ( random_in_range(0u, 9u) ) {
+    case 0: ds.add_affiliation(aff(), random_name(6), random_coord()); break;
+    case 1: ds.change_affiliation_coord(aff(), random_coord()); break;
+    case 2: ds.add_publication(pub(), random_name(12), random_in_range(1990, 2020), {aff(), aff()}); break;
+    case 3: ds.add_reference(pub(), pub()); break;
+    case 4: ds.add_affiliation_to_publication(aff(), pub()); break;
+    case 5: ds.remove_affiliation(aff()); break;
+    case 6: ds.remove_publications({pub(), pub()}); break;
+    case 7: ds.add_affiliations({{aff(), random_name(6), random_coord()}, {aff(), random_name(6), random_coord()}}); break;
+    case 8: ds.add_publications({{pub(), random_name(12), 2000, {aff()}}, {pub(), random_name(12), 2001, {aff(), aff()}}}); break;
+    case 9: ds.add_references({{pub(), pub()}, {pub(), pub()}}); break;
+    }
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int rounds = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 300;
+
+    rand_engine.seed(1);
+    Datastructures ds;
+    fill(ds, 40, 200);
+    for ( unsigned int round = 0; round < rounds; ++round ) {
+        unsigned int updates = random_in_range(0u, 12u);
+        for ( unsigned int i = 0; i < updates; ++i ) { update(ds); }
+        if ( round % 50 == 17 ) { ds.compact(); }
+        if ( round % 97 == 60 ) {
+            ds.clear_all();
+            fill(ds, 40, 200);
+        }
+
+        //Now and then a reader keeps a snapshot over the next publish
+        std::shared_ptr<const Snapshot> held;
+        std::vector<std::string> held_answers;
+        if ( round % 7 == 3 ) {
+            held = ds.snapshot();
+            if ( held ) { held_answers = answers(*held); }
+        }
+
+        ds.publish_snapshot();
+        auto snap = ds.snapshot();
+        check(snap && answers(*snap) == answers(ds), "snapshot of round " + std::to_string(round));
+        if ( held ) {
+            for ( unsigned int i = 0; i < 5; ++i ) { update(ds); }
+            ds.publish_snapshot();
+            check(answers(*held) == held_answers, "held snapshot unchanged in round " + std::to_string(round));
+            check(answers(*ds.snapshot()) == answers(ds), "snapshot after a held one in round " + std::to_string(round));
+        }
+    }
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "publish ok" << std::endl;
+    return 0;
+}
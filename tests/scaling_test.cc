@@ -0,0 +1,113 @@
+// Scaling_test.cc
+//
+// Point queries and existence checks have to stay flat when the store grows
+// from 10k to 10M publications: every one of them is a single hashed probe.
+// The same 1024 existing and 1024 missing IDs are queried at every size, so
+// that an O(n) search would show up as a slope of 1 on the log-log scale
+// while a hashed probe stays at 0.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/scaling_test.cc -o scaling_test
+//   ./scaling_test [largest size, default 10000000]
+// Exit status is 1 if any query grows.
+
+#include "bench/harness.hh"
+
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+using namespace harness;
+
+namespace
+{
+const unsigned int PROBES = 1024;
+const double MAX_FLAT_SLOPE = 0.2;
+
+struct Query
+{
+    char const* name;
+    std::function<void(Datastructures&, unsigned int)> call;  // call(ds, i), i = probe number
+};
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int largest = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+
+    //Probe i picks existing[i % PROBES] or a missing ID, each half of the time
+    std::vector<PublicationID> pubs;
+    std::vector<AffiliationID> affs;
+    std::vector<PublicationID> missing_pubs;
+    std::vector<AffiliationID> missing_affs;
+
+    std::vector<Query> queries = {
+        {"get_publication_name", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_publication_name(i % 2 ? pubs[i % PROBES] : missing_pubs[i % PROBES])); }},
+        {"get_publication_year", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_publication_year(i % 2 ? pubs[i % PROBES] : missing_pubs[i % PROBES])); }},
+        {"get_affiliations", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_affiliations(i % 2 ? pubs[i % PROBES] : missing_pubs[i % PROBES])); }},
+        {"get_parent", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_parent(i % 2 ? pubs[i % PROBES] : missing_pubs[i % PROBES])); }},
+        {"get_affiliation_name", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_affiliation_name(i % 2 ? affs[i % PROBES] : missing_affs[i % PROBES])); }},
+        {"get_affiliation_coord", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.get_affiliation_coord(i % 2 ? affs[i % PROBES] : missing_affs[i % PROBES])); }},
+        //Existence checks, all of these are rejected without changing anything
+        {"add_affiliation (exists)", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.add_affiliation(affs[i % PROBES], "x", {0, 0})); }},
+        {"add_publication (exists)", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.add_publication(pubs[i % PROBES], "x", 2000, {})); }},
+        {"add_reference (missing)", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.add_reference(pubs[i % PROBES], missing_pubs[i % PROBES])); }},
+        {"add_affiliation_to_publication (missing)", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.add_affiliation_to_publication(missing_affs[i % PROBES], pubs[i % PROBES])); }},
+        {"remove_publication (missing)", [&](Datastructures& ds, unsigned int i) {
+             keep(ds.remove_publication(missing_pubs[i % PROBES])); }},
+    };
+
+    std::vector<double> sizes;
+    std::vector<std::vector<double>> times(queries.size());
+
+    std::cout << std::setw(42) << std::left << "ns/call" << std::right;
+    for ( unsigned int n = 10000; n <= largest; n *= 10 ) { std::cout << std::setw(10) << n; }
+    std::cout << std::endl;
+
+    for ( unsigned int n = 10000; n <= largest; n *= 10 ) {
+        Datastructures ds;
+        rand_engine.seed(n);
+        fill(ds, n / 10, n);
+        sizes.push_back(n);
+
+        pubs.clear();
+        affs.clear();
+        missing_pubs.clear();
+        missing_affs.clear();
+        for ( unsigned int i = 0; i < PROBES; ++i ) {
+            pubs.push_back(publication_id(random_in_range(0u, n - 1)));
+            affs.push_back(affiliation_id(random_in_range(0u, n / 10 - 1)));
+            missing_pubs.push_back(publication_id(random_in_range(0u, n - 1)) + 1);
+            missing_affs.push_back("B" + std::to_string(random_in_range(0u, n - 1)));
+        }
+
+        for ( std::size_t q = 0; q < queries.size(); ++q ) {
+            times[q].push_back(ns_per_call([&](unsigned int i) { queries[q].call(ds, i); }, 2 * PROBES));
+        }
+    }
+
+    bool ok = true;
+    for ( std::size_t q = 0; q < queries.size(); ++q ) {
+        Fit fit = fit_growth(sizes, times[q]);
+        bool flat = fit.slope < MAX_FLAT_SLOPE;
+        ok = ok && flat;
+
+        std::cout << std::setw(42) << std::left << queries[q].name << std::right << std::fixed << std::setprecision(1);
+        for ( auto t : times[q] ) { std::cout << std::setw(10) << t; }
+        std::cout << "   slope " << std::setprecision(2) << fit.slope << (flat ? "" : "   GROWS") << std::endl;
+    }
+
+    std::cout << (ok ? "scaling_test ok" : "scaling_test FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
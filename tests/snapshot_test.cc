@@ -0,0 +1,134 @@
+// Snapshot_test.cc
+//
+// A store loaded from a save_snapshot file has to give exactly the same
+// answers as the one it was saved from, in the same order: lists that are
+// in no particular order (the publications of an affiliation, connections,
+// substring matches) must not come back reordered after a round trip.
+// Removals before the save reorder those lists and leave free handles and
+// slots behind. A truncated file must be rejected and leave the store as
+// it was.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -pthread -I. datastructures.cc tests/snapshot_test.cc -o snapshot_test
+//   ./snapshot_test [publications, default 20000]
+// Exit status is 1 on any failure.
+
+#include "bench/harness.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace harness;
+
+namespace
+{
+const char* const SNAPSHOT_FILE = "snapshot_test.snap";
+
+unsigned int failures = 0;
+
+void check(bool ok, std::string const& what)
+{
+    if ( !ok ) {
+        std::cout << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+std::string text(AffiliationID const& id) { return id; }
+std::string text(PublicationID id) { return std::to_string(id); }
+std::string text(Connection const& c) { return c.aff1 + "-" + c.aff2 + ":" + std::to_string(c.weight); }
+std::string text(std::pair<Year, PublicationID> const& p) { return std::to_string(p.first) + ":" + std::to_string(p.second); }
+
+// Answers of the queries, in the order the store gives them
+std::vector<std::string> answers(Datastructures& ds)
+{
+    std::vector<std::string> out;
+    auto join = [&](auto const& ids)
+    {
+        std::string line;
+        for ( auto const& id : ids ) { line += " " + text(id); }
+        out.push_back(line);
+    };
+
+    auto affs = ds.get_affiliations_alphabetically();
+    join(affs);
+    join(ds.get_affiliations_distance_increasing());
+    for ( auto const& a : affs ) {
+        Coord xy = ds.get_affiliation_coord(a);
+        out.push_back(a + " " + ds.get_affiliation_name(a) + " " + std::to_string(xy.x) + " " + std::to_string(xy.y));
+        join(ds.get_publications(a));
+        join(ds.get_connected_affiliations(a));
+        join(ds.get_publications_after(a, 0));
+        join(ds.get_affiliations_nearest(xy, 5));
+    }
+    auto pubs = ds.all_publications();
+    std::sort(pubs.begin(), pubs.end());
+    for ( auto p : pubs ) {
+        auto name = ds.get_publication_name(p);
+        out.push_back(std::to_string(p) + " " + name + " " + std::to_string(ds.get_publication_year(p)));
+        join(ds.get_affiliations(p));
+        join(ds.get_direct_references(p));
+        join(ds.get_referenced_by_chain(p));
+        join(ds.find_publications_by_name(name));
+        join(ds.find_publications_by_substring(name.substr(2, 5)));
+    }
+    join(ds.get_all_connections());
+    out.push_back(std::to_string(ds.get_total_publication_count_between(0, 3000)));
+    return out;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    unsigned int affiliations = n / 10;
+
+    rand_engine.seed(1);
+    Datastructures ds;
+    fill(ds, affiliations, n);
+    for ( unsigned int i = 0; i < n; i += 7 ) { ds.remove_publication(publication_id(i)); }
+    for ( unsigned int i = 0; i < affiliations; i += 11 ) { ds.remove_affiliation(affiliation_id(i)); }
+    auto before = answers(ds);
+
+    check(ds.save_snapshot(SNAPSHOT_FILE), "save");
+    Datastructures loaded;
+    loaded.add_affiliation("old", "Old", {1, 1});
+    check(loaded.load_snapshot(SNAPSHOT_FILE), "load");
+    check(answers(loaded) == before, "same answers in the same order after a round trip");
+
+    //Both keep working the same way
+    for ( Datastructures* store : {&ds, &loaded} ) {
+        rand_engine.seed(2);
+        fill(*store, 20, 200);
+        store->remove_publication(publication_id(8));
+        store->remove_affiliation(affiliation_id(5));
+    }
+    check(answers(loaded) == answers(ds), "updates after loading");
+
+    //Truncated files are rejected and the store is left alone
+    std::string bytes;
+    {
+        std::ifstream in(SNAPSHOT_FILE, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto kept = answers(loaded);
+    for ( std::size_t cut = 0; cut < bytes.size(); cut += bytes.size() / 50 + 1 ) {
+        {
+            std::ofstream out(SNAPSHOT_FILE, std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), cut);
+        }
+        check(!loaded.load_snapshot(SNAPSHOT_FILE), "truncated at " + std::to_string(cut));
+    }
+    check(answers(loaded) == kept, "store left alone by the failed loads");
+    std::remove(SNAPSHOT_FILE);
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "snapshot ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,99 @@
+// Views_test.cc
+//
+// The views have to show the same contents as the vector returning
+// operations, and a view taken again after an update has to show the update.
+// The updates here grow the lists of other IDs past their inline space and
+// back, so the old views really are moved from under (see the invalidation
+// rules in datastructures.hh): built with -fsanitize=address, any view read
+// after an update that wasn't taken again would be reported.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O1 -g -fsanitize=address -pthread -I. datastructures.cc tests/views_test.cc -o views_test
+//   ./views_test
+// Exit status is 1 if any view differs.
+
+#include "datastructures.hh"
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+unsigned int failures = 0;
+
+template <typename View, typename T>
+void check(char const* what, View const& view, std::vector<T> const& expected)
+{
+    if ( std::vector<T>(view.begin(), view.end()) != expected ) {
+        std::cout << what << ": view differs" << std::endl;
+        ++failures;
+    }
+}
+
+// All per-ID views against the copies, for every affiliation and publication
+void check_all(Datastructures& ds, std::vector<PublicationID> const& pubs)
+{
+    for ( auto const& a : ds.get_all_affiliations() ) {
+        check("view_publications", ds.view_publications(a), ds.get_publications(a));
+    }
+    for ( auto p : pubs ) {
+        check("view_affiliations", ds.view_affiliations(p), ds.get_affiliations(p));
+        check("view_direct_references", ds.view_direct_references(p), ds.get_direct_references(p));
+    }
+    check("view_all_affiliations", ds.view_all_affiliations(), ds.get_all_affiliations());
+    check("view_all_publications", ds.view_all_publications(), ds.all_publications());
+}
+}
+
+int main()
+{
+    Datastructures ds;
+    ds.add_affiliation("a", "A", {1, 1});
+    ds.add_affiliation("b", "B", {2, 2});
+    std::vector<PublicationID> pubs;
+    for ( PublicationID p = 1; p <= 8; ++p ) {
+        ds.add_publication(p, "P" + std::to_string(p), 2000 + p, {"a"});
+        pubs.push_back(p);
+    }
+
+    //The reviewer's case: a view of "a", then "b" gets new publications,
+    //which moves the lists. The view is taken again before it is read.
+    auto view = ds.view_publications("a");
+    check("view_publications before", view, ds.get_publications("a"));
+    for ( auto p : pubs ) { ds.add_affiliation_to_publication("b", p); }
+    view = ds.view_publications("a");
+    check("view_publications after", view, ds.get_publications("a"));
+
+    //Queries don't invalidate views
+    auto refs = ds.view_direct_references(1);
+    for ( PublicationID p = 2; p <= 8; ++p ) { ds.add_reference(p, 1); }
+    refs = ds.view_direct_references(1);
+    std::vector<PublicationID> before(refs.begin(), refs.end());
+    ds.get_publications_after("a", 2003);
+    ds.get_all_references(1);
+    ds.get_affiliations_distance_increasing();
+    ds.is_ancestor(1, 8);
+    check("view_direct_references across queries", refs, before);
+
+    //Growth, removals and compaction all move lists around
+    for ( PublicationID p = 9; p <= 200; ++p ) {
+        ds.add_publication(p, "P" + std::to_string(p), 2000, {p % 2 ? "a" : "b"});
+        ds.add_reference(p, p / 2);
+        pubs.push_back(p);
+    }
+    check_all(ds, pubs);
+    for ( PublicationID p = 9; p <= 200; p += 3 ) { ds.remove_publication(p); }
+    ds.remove_affiliation("b");
+    std::vector<PublicationID> left;
+    for ( auto p : pubs ) { if ( ds.get_publication_name(p) != NO_NAME ) { left.push_back(p); } }
+    check_all(ds, left);
+    ds.compact();
+    check_all(ds, left);
+
+    if ( failures > 0 ) {
+        std::cout << failures << " failures" << std::endl;
+        return 1;
+    }
+    std::cout << "views ok" << std::endl;
+    return 0;
+}